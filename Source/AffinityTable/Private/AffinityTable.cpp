@@ -16,8 +16,31 @@
 
 #include "AffinityTable.h"
 #include "AffinityTablePage.h"
-
+#include "AffinityTableQueryCache.h"
+
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+#include "GameplayTagsManager.h"
+#include "GameplayTagsModule.h"
+#include "GameplayTagRedirectors.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/MemStack.h"
+#include "Serialization/CustomVersion.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/ObjectAndNameAsStringProxyArchive.h"
+#include "UObject/CoreRedirects.h"
+#include "UObject/GarbageCollection.h"
 #include "UObject/LinkerLoad.h"
+#include "UObject/ObjectRedirector.h"
+#include "UObject/SoftObjectPtr.h"
+#include "UObject/UObjectIterator.h"
+
+#if PLATFORM_UNIX
+#include <sys/mman.h>
+#elif PLATFORM_WINDOWS
+#include "Windows/WindowsHWrapper.h"
+#endif
 
 DEFINE_LOG_CATEGORY(LogAffinityTable);
 
@@ -28,7 +51,158 @@ DEFINE_LOG_CATEGORY(LogAffinityTable);
 // 2: Structures are no longer transient since they must be loaded before this table can serialize.
 // 3: Per-structure inheritance maps
 // 4: Last known structure footprints
-constexpr uint32 UAffinityTable::FileFormatVersion = 4;
+// 5: Per-page encoding. Cooked plain-data pages carry a raw memory image ahead of their tagged data
+// 6: Table directory with the offset and size of every page and section
+// 7: On-demand page images in bulk data
+// 8: Editor pages as self-contained cell records. Cooked cells in schema order
+constexpr uint32 UAffinityTable::FileFormatVersion = 8;
+constexpr uint32 UAffinityTable::MinFileFormatVersion = 3;
+
+static int32 GAffinityTablePageCacheBudgetKB = 64 * 1024;
+static FAutoConsoleVariableRef CVarAffinityTablePageCacheBudgetKB(
+	TEXT("AffinityTable.PageCacheBudgetKB"),
+	GAffinityTablePageCacheBudgetKB,
+	TEXT("Default budget for expanded compressed pages of each affinity table, in KB. Tables can override it with PageCacheBudgetKB."));
+
+#if WITH_EDITOR
+static bool GAffinityTableReuseCellRecords = true;
+static FAutoConsoleVariableRef CVarAffinityTableReuseCellRecords(
+	TEXT("AffinityTable.ReuseCellRecords"),
+	GAffinityTableReuseCellRecords,
+	TEXT("If true, editor saves copy the serialized form of cells nobody marked dirty instead of serializing them again. ")
+	TEXT("Disable it to serialize every cell on each save, should some code write cell data without marking it dirty."));
+#endif
+
+/** Scratch sets of batch queries: inline, then the calling thread's FMemStack. Nothing of a batch touches the heap */
+using FBatchSetAllocator = TInlineSetAllocator<32, TSetAllocator<TSparseArrayAllocator<TMemStackAllocator<>, TMemStackAllocator<>>, TMemStackAllocator<>>>;
+
+/** Scratch bit arrays of batch queries, see FBatchSetAllocator */
+using FBatchBitAllocator = TInlineAllocator<4, TMemStackAllocator<>>;
+
+static FAutoConsoleCommandWithOutputDevice CmdAffinityTableDumpMemoryStats(
+	TEXT("AffinityTable.DumpMemoryStats"),
+	TEXT("Writes the memory usage of every page of every loaded affinity table."),
+	FConsoleCommandWithOutputDeviceDelegate::CreateStatic([](FOutputDevice& Ar) {
+		for (TObjectIterator<UAffinityTable> It; It; ++It)
+		{
+			It->DumpMemoryStats(Ar);
+		}
+	}));
+
+// Cell records
+//////////////////////////////////////////////////////////////////////////
+
+/**
+ * Serializes a single cell with names and objects by path, so its bytes do not depend on the archive they end up in.
+ * Collects the objects the cell references, which that archive must still see, and the paths the cell names them by.
+ * See UAffinityTable::SaveCellBlob.
+ */
+class FAffinityTableCellArchive : public FObjectAndNameAsStringProxyArchive
+{
+public:
+	/**
+	 * @param InInnerArchive Memory archive that holds the cell
+	 * @param OutReferences Receives the objects referenced by the cell
+	 * @param OutReferencePaths Receives the path of each object in OutReferences, as written in the cell
+	 * @param OutSoftReferences Receives the soft object paths referenced by the cell
+	 * @param bInLoadIfFindFails If true, loading the cell loads the objects it references that are not loaded yet
+	 */
+	FAffinityTableCellArchive(FArchive& InInnerArchive, TArray<UObject*>& OutReferences, TArray<FString>& OutReferencePaths, TArray<FSoftObjectPath>& OutSoftReferences,
+		const bool bInLoadIfFindFails = true)
+		: FObjectAndNameAsStringProxyArchive(InInnerArchive, bInLoadIfFindFails)
+		, References(OutReferences)
+		, ReferencePaths(OutReferencePaths)
+		, SoftReferences(OutSoftReferences)
+	{
+	}
+
+	virtual FArchive& operator<<(UObject*& Obj) override
+	{
+		FString Path;
+		if (IsLoading())
+		{
+			// Read the path ourselves: it may name a redirector, or an object that has moved since
+			InnerArchive << Path;
+			Obj = Path.IsEmpty() ? nullptr : FindObject<UObject>(nullptr, *Path, false);
+			if (!Obj && !Path.IsEmpty() && bLoadIfFindFails)
+			{
+				Obj = LoadObject<UObject>(nullptr, *Path);
+			}
+			if (const UObjectRedirector* Redirector = Cast<UObjectRedirector>(Obj))
+			{
+				Obj = Redirector->DestinationObject;
+			}
+		}
+		else
+		{
+			FObjectAndNameAsStringProxyArchive::operator<<(Obj);
+			Path = Obj ? Obj->GetPathName() : FString();
+		}
+
+		if (Obj && !References.Contains(Obj))
+		{
+			References.Add(Obj);
+			ReferencePaths.Add(MoveTemp(Path));
+		}
+		return *this;
+	}
+
+	virtual FArchive& operator<<(FObjectPtr& Obj) override
+	{
+		UObject* Object = Obj.Get();
+		*this << Object;
+		Obj = FObjectPtr(Object);
+		return *this;
+	}
+
+	virtual FArchive& operator<<(FWeakObjectPtr& Obj) override
+	{
+		// Weak references do not keep their objects around, so they are not collected
+		UObject* Object = Obj.Get(true);
+		FObjectAndNameAsStringProxyArchive::operator<<(Object);
+		Obj = Object;
+		return *this;
+	}
+
+	virtual FArchive& operator<<(FSoftObjectPath& Value) override
+	{
+		FArchiveProxy::operator<<(Value);
+		if (!Value.IsNull())
+		{
+			SoftReferences.AddUnique(Value);
+		}
+		return *this;
+	}
+
+	virtual FArchive& operator<<(FSoftObjectPtr& Value) override
+	{
+		FSoftObjectPath Path = Value.ToSoftObjectPath();
+		*this << Path;
+		if (IsLoading())
+		{
+			Value = Path;
+		}
+		return *this;
+	}
+
+	virtual FString GetArchiveName() const override
+	{
+		return TEXT("FAffinityTableCellArchive");
+	}
+
+private:
+	TArray<UObject*>& References;
+	TArray<FString>& ReferencePaths;
+	TArray<FSoftObjectPath>& SoftReferences;
+};
+
+/** C++ type of a property including its template arguments, as saved in cell schemas */
+static FString GetSchemaType(const FProperty* Property)
+{
+	FString ExtendedType;
+	const FString Type = Property->GetCPPType(&ExtendedType, CPPF_None);
+	return Type + ExtendedType;
+}
 
 // AffinityTable
 //////////////////////////////////////////////////////////////////////////
@@ -54,6 +228,28 @@ UAffinityTable::~UAffinityTable()
 	ClearTable();
 }
 
+void UAffinityTable::BeginDestroy()
+{
+	// Stop following the tag tree as soon as we are on our way out, not whenever our memory is reclaimed
+	if (TagTreeChangedHandle.IsValid())
+	{
+		IGameplayTagsModule::OnGameplayTagTreeChanged.Remove(TagTreeChangedHandle);
+		TagTreeChangedHandle.Reset();
+	}
+	Super::BeginDestroy();
+}
+
+void UAffinityTable::PostInitProperties()
+{
+	Super::PostInitProperties();
+
+	// Objects constructed by the async loading thread start following the tree in PostLoad instead
+	if (IsInGameThread())
+	{
+		FollowTagTree();
+	}
+}
+
 void UAffinityTable::GetPreloadDependencies(TArray<UObject*>& OutDeps)
 {
 	Super::GetPreloadDependencies(OutDeps);
@@ -63,6 +259,64 @@ void UAffinityTable::GetPreloadDependencies(TArray<UObject*>& OutDeps)
 	}
 }
 
+void UAffinityTable::PostLoad()
+{
+	Super::PostLoad();
+	FollowTagTree();
+
+#if WITH_EDITOR
+	// Deleting orphans needs our pages, so tables with a broken hierarchy build them right away
+	const bool BrokenHierarchy = HasOrphanTags();
+#else
+	const bool BrokenHierarchy = false;
+#endif
+
+	// Our structures are linked by now. Build our pages on a worker task, so tables loading together build in parallel.
+	// Queries and mutators wait for the build to finish, see EnsurePagesBuilt. Without pages to build there is nothing
+	// to overlap, and rebuilding derived data here keeps it off other threads while game code starts mutating the table.
+	if (!PendingPages.Num() || BrokenHierarchy)
+	{
+		BuildPendingPages();
+	}
+	else
+	{
+		bPagesPending.store(true, std::memory_order_release);
+		PageBuild = Async(EAsyncExecution::TaskGraph, [this]() {
+			// Cell blobs find the objects they reference by path. Keep those around until the build is done.
+			FGCScopeGuard GCGuard;
+			PageBuildThread.store(FPlatformTLS::GetCurrentThreadId(), std::memory_order_relaxed);
+			BuildPendingPages();
+			PageBuildThread.store(0, std::memory_order_relaxed);
+			bPagesPending.store(false, std::memory_order_release);
+		});
+	}
+
+#if WITH_EDITOR
+	if (BrokenHierarchy)
+	{
+		EnsureTagHierarchy();
+	}
+
+	if (bTagsRedirected)
+	{
+		// Packages cannot be dirtied while the editor loads them, only by commandlets. Ask for the resave regardless.
+		UE_LOG(LogAffinityTable, Warning, TEXT("Tags on affinity table %s were redirected while loading, please resave it"), *GetPathName());
+		MarkPackageDirty();
+	}
+#endif
+}
+
+#if WITH_EDITOR
+void UAffinityTable::PreSave(FObjectPreSaveContext SaveContext)
+{
+	Super::PreSave(SaveContext);
+
+	// Package saves are a good time to get rid of the fragmentation left by editing. Serialize is not: it also runs for
+	// transactions, which record the table in the middle of edits that hold cell pointers.
+	CompactPages();
+}
+#endif
+
 bool UAffinityTable::Query(const CellTags& InCellTags, const bool ExactMatch, TArray<const UScriptStruct*>& InStructureTypes, TArray<FAffinityTableCellDataWrapper>& OutMemoryPtrs) const
 {
 	bool QueryResult = false;
@@ -93,6 +347,239 @@ bool UAffinityTable::Query(const CellTags& InCellTags, const bool ExactMatch, TA
 	return QueryResult;
 }
 
+bool UAffinityTable::Query(const CellTags& InCellTags, const bool ExactMatch, TConstArrayView<PageIndex> InPages, TArrayView<uint8*> OutData) const
+{
+	check(OutData.Num() >= InPages.Num());
+	EnsurePagesBuilt();
+
+	bool QueryResult = false;
+	if (Pages.Num())
+	{
+		// Make sure we have a result. Cell indexes will be invalid if we didn't find an exact match or a closest match.
+		if (const Cell QueriedCell{ GetRowIndex(InCellTags.Row, ExactMatch), GetColumnIndex(InCellTags.Column, ExactMatch) };
+			QueriedCell.Row != InvalidIndex && QueriedCell.Column != InvalidIndex)
+		{
+			QueryResult = true;
+			for (int32 i = 0; i < InPages.Num(); ++i)
+			{
+				OutData[i] = GetCellData(QueriedCell, InPages[i]);
+				if (!OutData[i])
+				{
+					UE_LOG(LogAffinityTable, Error, TEXT("AffinityTable query requested the page %d, not included on table %s (or the page has no data)"), InPages[i], *GetPathName());
+					QueryResult = false;
+				}
+			}
+			return QueryResult;
+		}
+	}
+
+	for (int32 i = 0; i < InPages.Num(); ++i)
+	{
+		OutData[i] = nullptr;
+	}
+	return QueryResult;
+}
+
+int32 UAffinityTable::QueryBatch(TConstArrayView<CellTags> InCellTags, const bool ExactMatch, TConstArrayView<PageIndex> InPages, TArrayView<uint8*> OutData, const bool AllowParallel) const
+{
+	// Scratch memory is released when we return
+	FMemMark Mark(FMemStack::Get());
+
+	// Batches usually repeat a few tags many times (every unit against every terrain). Resolve each unique tag once.
+	TArray<Cell, TMemStackAllocator<>> Cells;
+	Cells.SetNumUninitialized(InCellTags.Num());
+
+	TMap<FGameplayTag, TagIndex, FBatchSetAllocator> RowIndexes, ColumnIndexes;
+	for (int32 i = 0; i < InCellTags.Num(); ++i)
+	{
+		const CellTags& Tags = InCellTags[i];
+		const TagIndex* RowIndex = RowIndexes.Find(Tags.Row);
+		if (!RowIndex)
+		{
+			RowIndex = &RowIndexes.Add(Tags.Row, GetRowIndex(Tags.Row, ExactMatch));
+		}
+		const TagIndex* ColumnIndex = ColumnIndexes.Find(Tags.Column);
+		if (!ColumnIndex)
+		{
+			ColumnIndex = &ColumnIndexes.Add(Tags.Column, GetColumnIndex(Tags.Column, ExactMatch));
+		}
+		Cells[i] = Cell{ *RowIndex, *ColumnIndex };
+	}
+
+	return QueryBatch(Cells, InPages, OutData, AllowParallel);
+}
+
+int32 UAffinityTable::QueryBatch(TConstArrayView<Cell> InCells, TConstArrayView<PageIndex> InPages, TArrayView<uint8*> OutData, const bool AllowParallel) const
+{
+	const int32 PageCount = InPages.Num();
+	check(OutData.Num() >= InCells.Num() * PageCount);
+
+	FMemMark Mark(FMemStack::Get());
+
+	// Resolve our pages once for the whole batch. Unknown pages produce no data.
+	TArray<const FAffinityTablePage*, TInlineAllocator<16, TMemStackAllocator<>>> BatchPages;
+	for (const PageIndex Page : InPages)
+	{
+		BatchPages.Add(GetResidentPage(Page, 0, 0));
+	}
+
+	// Load the row partitions of the batch up front, so the loop below only reads memory. Every load is requested
+	// before we wait on any of them.
+	if (RowPartitions.Num())
+	{
+		TBitArray<FBatchBitAllocator> BatchPartitions(false, RowPartitions.Num());
+		for (const Cell& ThisCell : InCells)
+		{
+			if (RowPartitionIndexes.IsValidIndex(ThisCell.Row))
+			{
+				BatchPartitions[RowPartitionIndexes[ThisCell.Row]] = true;
+			}
+		}
+
+		for (const bool Wait : { false, true })
+		{
+			for (int32 p = 0; p < PageCount; ++p)
+			{
+				const PageIndex Page = InPages[p];
+				if (!BatchPages[p] || !PageImages.IsValidIndex(Page) || !PageImages[Page] || !PageImages[Page]->PartitionStates.Num())
+				{
+					continue;
+				}
+				for (TConstSetBitIterator<FBatchBitAllocator> It(BatchPartitions); It; ++It)
+				{
+					LoadRowPartitions(Page, RowPartitions[It.GetIndex()].Begin, RowPartitions[It.GetIndex()].End, Wait);
+				}
+			}
+		}
+	}
+
+	int32 Matches = 0;
+	auto QueryRange = [&](const int32 Begin, const int32 End) {
+		int32 RangeMatches = 0;
+		for (int32 i = Begin; i < End; ++i)
+		{
+			const Cell& ThisCell = InCells[i];
+			uint8** CellOut = &OutData[i * PageCount];
+			const bool ValidCell = ThisCell.Row != InvalidIndex && ThisCell.Column != InvalidIndex;
+
+			int32 Found = 0;
+			for (int32 p = 0; p < PageCount; ++p)
+			{
+				uint8* Data = (ValidCell && BatchPages[p]) ? BatchPages[p]->GetDatablockPtr(ThisCell.Row, ThisCell.Column) : nullptr;
+				Found += Data ? 1 : 0;
+				CellOut[p] = Data;
+			}
+			RangeMatches += (Found == PageCount) ? 1 : 0;
+		}
+		FPlatformAtomics::InterlockedAdd(&Matches, RangeMatches);
+	};
+
+	if (AllowParallel && InCells.Num() > BatchQueryChunkSize)
+	{
+		const int32 ChunkCount = FMath::DivideAndRoundUp(InCells.Num(), BatchQueryChunkSize);
+		ParallelFor(ChunkCount, [&QueryRange, &InCells](const int32 Chunk) {
+			const int32 Begin = Chunk * BatchQueryChunkSize;
+			QueryRange(Begin, FMath::Min(Begin + BatchQueryChunkSize, InCells.Num()));
+		});
+	}
+	else
+	{
+		QueryRange(0, InCells.Num());
+	}
+	return Matches;
+}
+
+bool UAffinityTable::QueryCached(const CellTags& InCellTags, const bool ExactMatch, TConstArrayView<PageIndex> InPages, TArrayView<uint8*> OutData) const
+{
+	EnsurePagesBuilt();
+
+	check(OutData.Num() >= InPages.Num());
+
+	// Requested pages count as accessed, so idle page release and cache trims prefer evicting other pages
+	for (const PageIndex InPage : InPages)
+	{
+		TouchPage(InPage);
+	}
+
+	// Resolves the cell and its data on every resident page. On-demand pages that are not loaded yet are resolved
+	// when requested, so memoizing does not load every page. Returns false if any page was not resident: loading it
+	// does not advance our epoch, so such an entry would keep missing its data.
+	auto Resolve = [this, &InCellTags, ExactMatch](FAffinityTableQueryCache::FEntry& OutEntry) {
+		OutEntry.Row = GetRowIndex(InCellTags.Row, ExactMatch);
+		OutEntry.Column = GetColumnIndex(InCellTags.Column, ExactMatch);
+		OutEntry.PageData.Reset();
+		bool AllResident = true;
+		for (PageIndex i = 0; i < Pages.Num(); ++i)
+		{
+			const bool Resident = OutEntry.Row != InvalidIndex && OutEntry.Column != InvalidIndex && IsRowResident(i, OutEntry.Row, OutEntry.Row + 1);
+			AllResident &= Resident || OutEntry.Row == InvalidIndex || OutEntry.Column == InvalidIndex;
+			OutEntry.PageData.Add(Resident ? Pages[i]->GetDatablockPtr(OutEntry.Row, OutEntry.Column) : nullptr);
+		}
+		return AllResident;
+	};
+
+	// Copies the requested pages out of a resolved entry
+	TagIndex Row = InvalidIndex, Column = InvalidIndex;
+	auto Gather = [&InPages, &OutData, &Row, &Column](const FAffinityTableQueryCache::FEntry& InEntry) {
+		Row = InEntry.Row;
+		Column = InEntry.Column;
+		for (int32 i = 0; i < InPages.Num(); ++i)
+		{
+			OutData[i] = InEntry.PageData.IsValidIndex(InPages[i]) ? InEntry.PageData[InPages[i]] : nullptr;
+		}
+	};
+
+	// Read the epoch before anything we resolve: resolution rebuilds publish before they advance it. Tags unknown to
+	// the tags manager have no net index to key them by, so they are never memoized.
+	const uint32 CurrentEpoch = GetEpoch();
+	const UGameplayTagsManager& TagsManager = UGameplayTagsManager::Get();
+	const FGameplayTagNetIndex RowNetIndex = TagsManager.GetNetIndexFromTag(InCellTags.Row);
+	const FGameplayTagNetIndex ColumnNetIndex = TagsManager.GetNetIndexFromTag(InCellTags.Column);
+	const bool Memoize = QueryCache && RowNetIndex != INVALID_TAGNETINDEX && ColumnNetIndex != INVALID_TAGNETINDEX;
+	const uint64 Key = FAffinityTableQueryCache::MakeKey(RowNetIndex, ColumnNetIndex, ExactMatch);
+	if (!Memoize || !QueryCache->Find(Key, CurrentEpoch, Gather))
+	{
+		FAffinityTableQueryCache::FEntry Entry;
+		const bool AllResident = Resolve(Entry);
+		Gather(Entry);
+		if (Memoize && AllResident)
+		{
+			QueryCache->Add(Key, CurrentEpoch, MoveTemp(Entry));
+		}
+	}
+
+	// Pages that were not resident when the entry was resolved are loaded now, outside the cache lock
+	bool QueryResult = InPages.Num() > 0;
+	for (int32 i = 0; i < InPages.Num(); ++i)
+	{
+		if (!OutData[i] && Row != InvalidIndex && Column != InvalidIndex)
+		{
+			OutData[i] = GetCellData(Cell{ Row, Column }, InPages[i]);
+		}
+		QueryResult &= OutData[i] != nullptr;
+	}
+	return QueryResult;
+}
+
+void UAffinityTable::SetQueryCacheEnabled(const bool Enabled)
+{
+	bMemoizeQueries = Enabled;
+	if (!Enabled)
+	{
+		QueryCache.Reset();
+	}
+	else if (!QueryCache)
+	{
+		QueryCache = MakeUnique<FAffinityTableQueryCache>();
+	}
+}
+
+void UAffinityTable::GetQueryCacheStats(uint64& OutHits, uint64& OutMisses) const
+{
+	OutHits = QueryCache ? QueryCache->GetHits() : 0;
+	OutMisses = QueryCache ? QueryCache->GetMisses() : 0;
+}
+
 bool UAffinityTable::QueryForRow(const FGameplayTag& RowTag, const bool ExactMatch, TArray<const UScriptStruct*>& InStructureTypes, TArray<FCellDataArrayWrapper>& OutMemoryPtrs) const
 {
 	bool QueryResult = false;
@@ -132,356 +619,1678 @@ bool UAffinityTable::QueryForRow(const FGameplayTag& RowTag, const bool ExactMat
 	return QueryResult;
 }
 
+bool UAffinityTable::QueryForColumn(const FGameplayTag& ColumnTag, const bool ExactMatch, TArray<const UScriptStruct*>& InStructureTypes, TArray<FCellDataArrayWrapper>& OutMemoryPtrs) const
+{
+	bool QueryResult = false;
+	if (Structures.Num())
+	{
+		// Make sure we have a result. Will be invalid if we didn't find an exact match or a closest match.
+		if (const TagIndex ColumnIndex = GetColumnIndex(ColumnTag, ExactMatch);
+			ColumnIndex != InvalidIndex)
+		{
+			TArray<uint8*> Data;
+			// Insert data locations for all known requested structures. At this point, it is
+			// an error to query a structure we don't know about.
+			for (const UScriptStruct* Struct : InStructureTypes)
+			{
+				GetColumnData(ColumnIndex, Struct, Data);
+				if (Data.Num() > 0)
+				{
+					const int CurrIndex = OutMemoryPtrs.Num();
+					// The wrapper is an inconvenience, but most of the time queries will come from
+					// blueprint functions, which need it to move the data around.
+					OutMemoryPtrs.Add(FCellDataArrayWrapper());
+
+					for (uint8* CellData : Data)
+					{
+						OutMemoryPtrs[CurrIndex].CellDataArray.Add(FAffinityTableCellDataWrapper(CellData));
+					}
+					Data.Empty(Data.Num());
+				}
+				else
+				{
+					UE_LOG(LogAffinityTable, Error, TEXT("AffinityTable QueryForColumn requested the structure %s, not included on table %s (or the structure has no data)"), *Struct->GetName(), *GetPathName());
+				}
+			}
+			QueryResult = (OutMemoryPtrs.Num() == InStructureTypes.Num());
+		}
+	}
+	return QueryResult;
+}
+
+TAffinityTableCellRange<uint8> UAffinityTable::GetRowCells(const FGameplayTag& RowTag, const bool ExactMatch, const PageIndex InPage) const
+{
+	const TagIndex Row = GetRowIndex(RowTag, ExactMatch);
+	return MakeCellRange<uint8>(InPage, Row, Row == InvalidIndex ? Row : Row + 1, 0, MAX_uint32);
+}
+
+TAffinityTableCellRange<uint8> UAffinityTable::GetColumnCells(const FGameplayTag& ColumnTag, const bool ExactMatch, const PageIndex InPage) const
+{
+	const TagIndex Column = GetColumnIndex(ColumnTag, ExactMatch);
+	return MakeCellRange<uint8>(InPage, 0, MAX_uint32, Column, Column == InvalidIndex ? Column : Column + 1);
+}
+
+TAffinityTableCellRange<uint8> UAffinityTable::GetPageCells(const PageIndex InPage) const
+{
+	return MakeCellRange<uint8>(InPage, 0, MAX_uint32, 0, MAX_uint32);
+}
+
 UAffinityTable::TagIndex UAffinityTable::GetRowIndex(const FGameplayTag& InTag, bool ExactMatch) const
 {
-	return GetIndex(Rows, InTag, ExactMatch);
+	// Tag tree changes publish a new resolution instead of modifying this one, see Resolution
+	static const TArray<TagIndex> NoResolution;
+	const FResolution* Current = Resolution.load(std::memory_order_acquire);
+	return GetIndex(Rows, Current ? Current->Rows : NoResolution, InTag, ExactMatch);
 }
 
 UAffinityTable::TagIndex UAffinityTable::GetColumnIndex(const FGameplayTag& InTag, bool ExactMatch) const
 {
-	return GetIndex(Columns, InTag, ExactMatch);
+	static const TArray<TagIndex> NoResolution;
+	const FResolution* Current = Resolution.load(std::memory_order_acquire);
+	return GetIndex(Columns, Current ? Current->Columns : NoResolution, InTag, ExactMatch);
 }
 
 uint8* UAffinityTable::GetCellData(const Cell InCell, const UScriptStruct* InScriptStruct) const
+{
+	return GetCellData(InCell, GetPageIndex(InScriptStruct));
+}
+
+uint8* UAffinityTable::GetCellData(const Cell InCell, const PageIndex InPage) const
 {
 	FStructDatablock::DatablockPtr Data = nullptr;
-	if (const FAffinityTablePage* Page = GetPageForStruct(InScriptStruct))
+	if (const FAffinityTablePage* Page = GetResidentPage(InPage, InCell.Row, InCell.Row + 1))
 	{
 		Data = Page->GetDatablockPtr(InCell.Row, InCell.Column);
 	}
 	return Data;
 }
 
-void UAffinityTable::GetRowData(const TagIndex RowIndex, const UScriptStruct* InScriptStruct, TArray<uint8*>& OutData) const
+UAffinityTable::PageIndex UAffinityTable::GetPageIndex(const UScriptStruct* InScriptStruct) const
 {
-	if (const FAffinityTablePage* Page = GetPageForStruct(InScriptStruct))
-	{
-		Page->GetDatablockPtrsForRow(RowIndex, OutData);
-	}
-}
+	EnsurePagesBuilt();
 
-#if WITH_EDITOR
+	const PageIndex* FoundIndex = PageIndexes.Find(InScriptStruct);
+	return FoundIndex ? *FoundIndex : InvalidPageIndex;
+}
 
-void UAffinityTable::SetStructureChangeCallback(const StructureChangeCallback& InCallback)
+bool UAffinityTable::IsPageResident(const PageIndex InPage) const
 {
-	ChangeCallback = InCallback;
+	return IsRowResident(InPage, 0, InvalidIndex);
 }
 
-void UAffinityTable::PostEditChangeProperty(struct FPropertyChangedEvent& PropertyChangedEvent)
+bool UAffinityTable::IsRowResident(const PageIndex InPage, const TagIndex RowBegin, const TagIndex RowEnd) const
 {
-	Super::PostEditChangeProperty(PropertyChangedEvent);
+	EnsurePagesBuilt();
 
-	// Respond to Structure changes
-	if (const FName PropertyName = (PropertyChangedEvent.Property != nullptr)
-									   ? PropertyChangedEvent.Property->GetFName()
-									   : NAME_None;
-		PropertyName == GET_MEMBER_NAME_CHECKED(UAffinityTable, Structures))
+	if (!Pages.IsValidIndex(InPage))
 	{
-		static EPropertyChangeType::Type ObservedChanges = EPropertyChangeType::ValueSet | EPropertyChangeType::ArrayRemove | EPropertyChangeType::ArrayClear;
-		if (PropertyChangedEvent.ChangeType & ObservedChanges)
-		{
-			// Allocate memory for new pages. We must keep the dimensionality of other pages, which might include currently unused (deleted) rows.
-			// On the other hand, if we have no pages yet, go with the number of registered rows/columns
-			uint32 RowCount = Rows.Num();
-			uint32 ColumnCount = Columns.Num();
-			if (Pages.Num())
-			{
-				const TSharedRef<FAffinityTablePage> ExistingPage = Pages[0];
-				ExistingPage->GetRowAndColumnCount(RowCount, ColumnCount);
-			}
-
-			AllocatePageMemory(RowCount, ColumnCount);
-
-			if (ChangeCallback)
-			{
-				ChangeCallback(PropertyChangedEvent.ChangeType);
-			}
-		}
+		return false;
+	}
+	if (!PageImages.IsValidIndex(InPage) || !PageImages[InPage])
+	{
+		return true;
 	}
-}
 
-// The following 4 functions could be collapsed into fronts with a common add and a common delete, but
-// the gains are not much in terms of space or simplicity.
+	const PageImage& Image = *PageImages[InPage];
+	return Image.bResident.load(std::memory_order_acquire) && (!Image.PartitionStates.Num() || ArePartitionsResident(Image, RowBegin, RowEnd));
+}
 
-bool UAffinityTable::AddRow(const FGameplayTag& InTag)
+int32 UAffinityTable::CompactPages()
 {
-	if (InTag.IsValid() && !Rows.Contains(InTag))
+	EnsurePagesBuilt();
+
+	int32 Compacted = 0;
+	for (const TSharedRef<FAffinityTablePage>& Page : Pages)
 	{
-		MarkPackageDirty();
-		for (const TSharedRef<FAffinityTablePage>& Page : Pages)
+		Compacted += Page->Compact() ? 1 : 0;
+	}
+
+	if (Compacted)
+	{
+		// Cells moved, but kept their rows and columns: saved cells and projections are still valid
+		Epoch.fetch_add(1, std::memory_order_acq_rel);
+
+#if WITH_EDITOR
+		if (MovedCallback)
 		{
-			Page->AddRow();
+			MovedCallback();
 		}
-		Rows.Add(InTag, NextRowIndex++);
-
-		// Recursive add
-		const FGameplayTag Parent = InTag.RequestDirectParent();
-		AddRow(Parent);
-		return true;
+#endif
 	}
-	return false;
+	return Compacted;
 }
 
-bool UAffinityTable::AddColumn(const FGameplayTag& InTag)
+int32 UAffinityTable::ReleaseIdlePages(const uint64 IdleFrames)
 {
-	if (InTag.IsValid() && !Columns.Contains(InTag))
+	EnsurePagesBuilt();
+
+	int32 Released = 0;
 	{
-		MarkPackageDirty();
-		for (const TSharedRef<FAffinityTablePage>& Page : Pages)
+		FScopeLock Lock(&PageImageLock);
+		for (PageIndex i = 0; i < PageImages.Num(); ++i)
 		{
-			Page->AddColumn();
+			PageImage* Image = PageImages[i].Get();
+			// Pages with projections stay, or the next topology change would load them right back to refresh the
+			// projection. Mapped pages are paged out by the OS.
+			const bool HasProjection = PageProjections.IsValidIndex(i) && PageProjections[i];
+			if (Image && !HasProjection && !Image->BulkData.IsDataMemoryMapped() && Image->bResident.load(std::memory_order_acquire) &&
+				GFrameCounter - Image->LastAccessFrame.load(std::memory_order_relaxed) >= IdleFrames)
+			{
+				ReleasePageImage(i);
+				Released++;
+			}
 		}
-		Columns.Add(InTag, NextColumnIndex++);
+	}
 
-		const FGameplayTag Parent = InTag.RequestDirectParent();
-		AddColumn(Parent);
-		return true;
+	if (Released)
+	{
+		AdvanceEpoch();
 	}
-	return false;
+	return Released;
 }
 
-void UAffinityTable::DeleteRow(const FGameplayTag& InTag)
+void UAffinityTable::PrefaultMappedPages(const bool Blocking) const
 {
-	if (InTag.IsValid() && Rows.Contains(InTag))
+	EnsurePagesBuilt();
+
+	const SIZE_T OSPageSize = FPlatformMemory::GetConstants().PageSize;
+	for (PageIndex i = 0; i < PageImages.Num(); ++i)
 	{
-		MarkPackageDirty();
-		const TagIndex RowIndex = Rows[InTag];
-		for (const TSharedRef<FAffinityTablePage>& Page : Pages)
-		{
-			Page->DeleteRow(RowIndex);
-		}
-		Rows.Remove(InTag);
-		if (RowColors.Contains(InTag))
+		// Mapped images that could not be used in place were copied, and are already in memory
+		const FAffinityTablePage& Page = Pages[i].Get();
+		if (!PageImages[i] || !PageImages[i]->BulkData.IsDataMemoryMapped() || !Page.UsesExternalMemory())
 		{
-			RowColors.Remove(InTag);
+			continue;
 		}
-	}
-}
 
-void UAffinityTable::DeleteColumn(const FGameplayTag& InTag)
-{
-	if (InTag.IsValid() && Columns.Contains(InTag))
-	{
-		MarkPackageDirty();
-		const TagIndex ColIndex = Columns[InTag];
-		for (const TSharedRef<FAffinityTablePage>& Page : Pages)
+		const uint8* Data = Page.GetDatablockPtr(0, 0);
+		uint32 RowCount, ColumnCount;
+		Page.GetRowAndColumnCount(RowCount, ColumnCount);
+		const SIZE_T Size = static_cast<SIZE_T>(RowCount) * ColumnCount * Page.GetStructSize();
+
+		if (Blocking)
 		{
-			Page->DeleteColumn(ColIndex);
+			// Read one byte per OS page to fault the whole image in
+			volatile uint8 Sink = 0;
+			for (SIZE_T Offset = 0; Offset < Size; Offset += OSPageSize)
+			{
+				Sink += Data[Offset];
+			}
 		}
-		Columns.Remove(InTag);
-		if (ColumnColors.Contains(InTag))
+		else
 		{
-			ColumnColors.Remove(InTag);
+#if PLATFORM_UNIX
+			// madvise needs a page-aligned start
+			const UPTRINT Start = AlignDown(reinterpret_cast<UPTRINT>(Data), OSPageSize);
+			madvise(reinterpret_cast<void*>(Start), Size + (reinterpret_cast<UPTRINT>(Data) - Start), MADV_WILLNEED);
+#elif PLATFORM_WINDOWS
+			WIN32_MEMORY_RANGE_ENTRY Range;
+			Range.VirtualAddress = const_cast<uint8*>(Data);
+			Range.NumberOfBytes = Size;
+			PrefetchVirtualMemory(GetCurrentProcess(), 1, &Range, 0);
+#endif
 		}
 	}
 }
 
-void UAffinityTable::SetTagColor(const FGameplayTag& InTag, const FLinearColor& Color, const bool IsRowTag)
+void UAffinityTable::LoadPageImage(const PageIndex InPage) const
 {
-	if (TMap<FGameplayTag, FLinearColor>& ColorMap = IsRowTag
-														 ? RowColors
-														 : ColumnColors;
-		!ColorMap.Contains(InTag))
+	FScopeLock Lock(&PageImageLock);
+
+	PageImage& Image = *PageImages[InPage];
+	if (Image.bResident.load(std::memory_order_relaxed))
 	{
-		ColorMap.Add(InTag, Color);
-		MarkPackageDirty();
+		return;
 	}
-	else if (ColorMap[InTag] != Color)
+
+	FAffinityTablePage& Page = Pages[InPage].Get();
+
+	// Partitioned pages only reserve their memory: partitions are committed and loaded as they are queried
+	if (Image.PartitionStates.Num())
 	{
-		ColorMap[InTag] = Color;
-		MarkPackageDirty();
+		Page.ReserveDenseMemory();
+		Image.bResident.store(true, std::memory_order_release);
+		return;
+	}
+
+	Page.AllocateDenseMemory(false);
+	void* Data = Page.GetDatablockPtr(0, 0);
+
+	if (Image.CompressedData.Num())
+	{
+		verify(FCompression::UncompressMemory(PageCompressionFormat, Data, static_cast<int32>(Image.UncompressedSize), Image.CompressedData.GetData(), Image.CompressedData.Num()));
+		PageCacheBytes += Image.UncompressedSize;
+		PageCacheMisses.fetch_add(1, std::memory_order_relaxed);
 	}
+	else
+	{
+		// Copy the image straight into page memory, without keeping a copy in the bulk data
+		Image.BulkData.GetCopy(&Data, true);
+	}
+
+	Image.bResident.store(true, std::memory_order_release);
 }
 
-bool UAffinityTable::TryGetTagColor(const FGameplayTag& InTag, FLinearColor& OutColor, const bool IsRowTag) const
+void UAffinityTable::ReleasePageImage(const PageIndex InPage) const
 {
-	if (const TMap<FGameplayTag, FLinearColor>& ColorMap = IsRowTag
-															   ? RowColors
-															   : ColumnColors;
-		ColorMap.Contains(InTag))
+	PageImage& Image = *PageImages[InPage];
+	check(Image.bResident.load(std::memory_order_relaxed));
+
+	for (int32 i = 0; i < Image.PartitionStates.Num(); ++i)
 	{
-		OutColor = ColorMap[InTag];
-		return true;
+		if (Image.PartitionRequests[i])
+		{
+			Image.PartitionRequests[i]->WaitCompletion(0.0f);
+			Image.PartitionRequests[i].Reset();
+		}
+		Image.PartitionStates[i].store(static_cast<uint8>(EPartitionState::Unloaded), std::memory_order_relaxed);
+	}
+
+	Image.bResident.store(false, std::memory_order_release);
+	Pages[InPage]->ReleaseDenseMemory();
+	if (Image.CompressedData.Num())
+	{
+		PageCacheBytes -= Image.UncompressedSize;
+		PageCacheEvictions.fetch_add(1, std::memory_order_relaxed);
 	}
-	return false;
 }
 
-void UAffinityTable::SetInheritanceLink(const UScriptStruct* InStruct, const CellTags& Child, const CellTags& Parent)
+TUniquePtr<UAffinityTable::PageImage> UAffinityTable::CompressPage(FAffinityTablePage& InPage) const
 {
-	check(InStruct);
-
-	InheritanceMap& Map = InheritanceMaps.FindOrAdd(InStruct->GetFName());
-	if (const FString CellID = StringIDForCell(Child);
-		!Map.Contains(CellID))
+	uint32 RowCount, ColumnCount;
+	InPage.GetRowAndColumnCount(RowCount, ColumnCount);
+	if (!InPage.IsDense() || InPage.GetCellStride() != InPage.GetStructSize())
 	{
-		Map.Add(CellID, Parent);
-		MarkPackageDirty();
+		return nullptr;
 	}
-	else if (Map[CellID] != Parent)
+
+	TUniquePtr<PageImage> Image = CompressImage(InPage.GetDatablockPtr(0, 0), static_cast<int64>(RowCount) * ColumnCount * InPage.GetStructSize(), InPage.GetStruct());
+	if (Image)
 	{
-		Map[CellID] = Parent;
-		MarkPackageDirty();
+		InPage.ReleaseDenseMemory();
 	}
+	return Image;
 }
 
-bool UAffinityTable::TryGetInheritanceLink(const UScriptStruct* InStruct, const CellTags& Child, CellTags& OutParent)
+TUniquePtr<UAffinityTable::PageImage> UAffinityTable::CompressImage(const uint8* InData, const int64 InSize, const UScriptStruct* InStruct) const
 {
-	check(InStruct);
+	if (InSize > MAX_int32)
+	{
+		return nullptr;
+	}
 
-	InheritanceMap& Map = InheritanceMaps.FindOrAdd(InStruct->GetFName());
-	if (const FString CellID = StringIDForCell(Child);
-		Map.Contains(CellID))
+	TUniquePtr<PageImage> Image = MakeUnique<PageImage>();
+	int32 CompressedSize = FCompression::CompressMemoryBound(PageCompressionFormat, static_cast<int32>(InSize));
+	Image->CompressedData.SetNumUninitialized(CompressedSize);
+	if (!FCompression::CompressMemory(PageCompressionFormat, Image->CompressedData.GetData(), CompressedSize, InData, static_cast<int32>(InSize)))
 	{
-		OutParent = Map[CellID];
-		return true;
+		UE_LOG(LogAffinityTable, Warning, TEXT("Could not compress page %s on table %s with %s, it will stay expanded"),
+			*InStruct->GetName(), *GetPathName(), *PageCompressionFormat.ToString());
+		return nullptr;
 	}
-	return false;
+	Image->CompressedData.SetNum(CompressedSize);
+	Image->CompressedData.Shrink();
+	Image->UncompressedSize = InSize;
+	return Image;
 }
 
-void UAffinityTable::RemoveInheritanceLink(const UScriptStruct* InStruct, const CellTags& InCell)
+bool UAffinityTable::ShouldCompressPage(const UScriptStruct* InStruct, const uint32 InRows, const uint32 InColumns) const
 {
-	check(InStruct);
-	FString CellID = StringIDForCell(InCell);
-	SetInheritanceLink(InStruct, InCell, CellTags());
+	return bFixedModeActive && InRows * InColumns > 0 && CompressedStructures.Contains(InStruct) && FAffinityTablePage::SupportsRawImage(InStruct) &&
+		   !GetCellAlignment(InStruct);
 }
 
-bool UAffinityTable::AreCellsIdentical(const UScriptStruct* Struct, const Cell& CellA, const Cell& CellB) const
+int32 UAffinityTable::TrimPageCache()
 {
-	if (Struct && Struct->IsValidLowLevel() && Structures.Contains(Struct))
+	EnsurePagesBuilt();
+
+	const int64 Budget = static_cast<int64>(PageCacheBudgetKB > 0 ? PageCacheBudgetKB : GAffinityTablePageCacheBudgetKB) * 1024;
+
+	// Only runs while no query does, so any page may go, including those used this frame
+	int32 Released = 0;
+	FScopeLock Lock(&PageImageLock);
+	while (PageCacheBytes > Budget)
 	{
-		const uint8* DataA = GetCellData(CellA, Struct);
-		const uint8* DataB = GetCellData(CellB, Struct);
-		if (DataA && DataB)
+		// Least recently used expanded page. Pages with projections stay, see ReleaseIdlePages.
+		PageIndex Victim = InvalidPageIndex;
+		uint64 VictimFrame = MAX_uint64;
+		for (PageIndex i = 0; i < PageImages.Num(); ++i)
+		{
+			const PageImage* Image = PageImages[i].Get();
+			const bool HasProjection = PageProjections.IsValidIndex(i) && PageProjections[i];
+			if (Image && Image->CompressedData.Num() && !HasProjection && Image->bResident.load(std::memory_order_relaxed) &&
+				Image->LastAccessFrame.load(std::memory_order_relaxed) < VictimFrame)
+			{
+				Victim = i;
+				VictimFrame = Image->LastAccessFrame.load(std::memory_order_relaxed);
+			}
+		}
+
+		if (Victim == InvalidPageIndex)
 		{
-			return Struct->CompareScriptStruct(DataA, DataB, PPF_DeepComparison);
+			break;
 		}
+		ReleasePageImage(Victim);
+		Released++;
 	}
-	return false;
+
+	if (Released)
+	{
+		AdvanceEpoch();
+	}
+	return Released;
 }
 
-void UAffinityTable::PreSaveTable()
+void UAffinityTable::GetPageCacheStats(uint64& OutHits, uint64& OutMisses, uint64& OutEvictions) const
 {
-	// Fix-up our data: Unreal maps do not necessarily retrieve keys in insertion order, but indexes
-	// are always ordered sequentially. We need to store rows/cols in the exact order we want to read them later.
-	static auto IndexSort = [](const TagIndex A, const TagIndex B) { return A < B; };
-	Rows.ValueSort(IndexSort);
-	Columns.ValueSort(IndexSort);
+	OutHits = PageCacheHits.load(std::memory_order_relaxed);
+	OutMisses = PageCacheMisses.load(std::memory_order_relaxed);
+	OutEvictions = PageCacheEvictions.load(std::memory_order_relaxed);
+}
 
-	// Rows
-	Rows.GenerateKeyArray(RowTags);
+void UAffinityTable::DumpMemoryStats(FOutputDevice& Ar) const
+{
+	EnsurePagesBuilt();
 
-	// Columns
-	Columns.GenerateKeyArray(ColumnTags);
+	Ar.Logf(TEXT("%s: %d pages"), *GetPathName(), Pages.Num());
+	for (const TSharedRef<FAffinityTablePage>& Page : Pages)
+	{
+		FAffinityTablePage::MemoryStats Stats;
+		Page->GetMemoryStats(Stats);
+		const UScriptStruct* Struct = Page->GetStruct();
+		Ar.Logf(TEXT("  %s: %d datablocks (%d from the OS) of %u cells, %llu KB allocated, %llu KB overhead"),
+			Struct ? *Struct->GetName() : TEXT("None"), Stats.Datablocks, Stats.OSDatablocks, Stats.DatablockCapacity,
+			static_cast<uint64>(Stats.AllocatedBytes / 1024), static_cast<uint64>((Stats.AllocatedBytes - Stats.CellBytes) / 1024));
+	}
 }
 
-void UAffinityTable::SaveTable(FArchive& Ar)
+uint32 UAffinityTable::GetCellAlignment(const UScriptStruct* InStruct) const
 {
-	// Runtime data
-	//////////////////////////////////////////////////////////////////////////
-
-	// Format version
-	uint32 CurrentFormat = FileFormatVersion;
-	Ar << CurrentFormat;
+	return CacheLinePaddedStructures.Contains(InStruct) ? PLATFORM_CACHE_LINE_SIZE : 0;
+}
 
-	// Per-page data in row-major order, following insertion. Be pedantic and only save structures that have memory pages
-	// [Structure pathname, R0{data 0, ...data n}, ...Rm], ...
-	using ScriptPagePair = TPair<UScriptStruct*, FAffinityTablePage*>;
-	TArray<ScriptPagePair> StructsToSave;
-	for (UScriptStruct* Struct : Structures)
+UAffinityTable::PageImage::~PageImage()
+{
+	// Loads write into page memory: they must be done before the page goes away
+	for (TSharedPtr<IBulkDataIORequest, ESPMode::ThreadSafe>& Request : PartitionRequests)
 	{
-		FAffinityTablePage* Page = GetPageForStruct(Struct);
-		if (Page && Struct)
+		if (Request)
 		{
-			ScriptPagePair Pair(Struct, Page);
-			StructsToSave.Add(Pair);
+			Request->WaitCompletion(0.0f);
 		}
 	}
+}
 
-	int32 PagesToSave = StructsToSave.Num();
-	Ar << PagesToSave;
-
-	for (const ScriptPagePair& Pair : StructsToSave)
+void UAffinityTable::LoadRowPartitions(const PageIndex InPage, const TagIndex RowBegin, const TagIndex RowEnd, const bool Wait) const
+{
+	int32 First, Last;
+	if (!GetPartitionsForRows(RowBegin, RowEnd, First, Last))
 	{
-		FString StructName = Pair.Key->GetFName().ToString();
-		int32 StructFootprint = Pair.Value->GetStructSize();
-
-		Ar << StructName;
-		Ar << StructFootprint;
-		SerializePage(Ar, Pair.Value, Pair.Key);
+		return;
 	}
 
-	// Editor-only data
-	//////////////////////////////////////////////////////////////////////////
+	PageImage& Image = *PageImages[InPage];
+	FAffinityTablePage& Page = Pages[InPage].Get();
+	uint32 RowCount, ColumnCount;
+	Page.GetRowAndColumnCount(RowCount, ColumnCount);
+	const int64 RowSize = static_cast<int64>(ColumnCount) * Page.GetStructSize();
 
-	// Row and column colors
-	Ar << RowColors;
-	Ar << ColumnColors;
+	// Load callbacks hold on to their partition state
+	check(Image.PartitionStates.Num() == RowPartitions.Num());
 
-	// Inheritance map:
-	// let Links(page) = [ (Key, Row, Col), ... ] for each element of Map(page)
-	// let n = PagesToSave
-	// Then, serialized maps = Page 0 { Struct name, link count, Links }, ... Page n
-	Ar << PagesToSave;
-	for (const ScriptPagePair& Pair : StructsToSave)
+	// Requests are issued under the lock, but waited on after releasing it, so other threads can issue theirs meanwhile
+	TArray<TSharedPtr<IBulkDataIORequest, ESPMode::ThreadSafe>, TInlineAllocator<8>> InFlight;
+
+	FScopeLock Lock(&PageImageLock);
+	for (int32 i = First; i <= Last; ++i)
 	{
-		FName StructName = Pair.Key->GetFName();
-		Ar << StructName;
+		std::atomic<uint8>& State = Image.PartitionStates[i];
+		TSharedPtr<IBulkDataIORequest, ESPMode::ThreadSafe>& Request = Image.PartitionRequests[i];
 
-		int32 LinkCount = InheritanceMaps.Contains(StructName) ? InheritanceMaps[StructName].Num() : 0;
-		Ar << LinkCount;
+		// Retire finished loads. Failed loads go back to unloaded, and we try again.
+		if (Request && State.load(std::memory_order_acquire) != static_cast<uint8>(EPartitionState::Loading))
+		{
+			Request->WaitCompletion(0.0f);
+			Request.Reset();
+		}
 
-		if (LinkCount)
+		if (State.load(std::memory_order_acquire) == static_cast<uint8>(EPartitionState::Unloaded))
 		{
-			for (TPair<FString, CellTags>& CellLink : InheritanceMaps[StructName])
+			const IndexRange& Partition = RowPartitions[i];
+			Page.CommitDenseRows(Partition.Begin, Partition.End);
+			State.store(static_cast<uint8>(EPartitionState::Loading), std::memory_order_relaxed);
+
+			FBulkDataIORequestCallBack Callback = [&State](const bool bWasCancelled, IBulkDataIORequest*) {
+				State.store(static_cast<uint8>(bWasCancelled ? EPartitionState::Unloaded : EPartitionState::Resident), std::memory_order_release);
+			};
+			Request = TSharedPtr<IBulkDataIORequest, ESPMode::ThreadSafe>(Image.BulkData.CreateStreamingRequest(Partition.Begin * RowSize,
+				Partition.Num() * RowSize, AIOP_Normal, &Callback, Page.GetDatablockPtr(Partition.Begin, 0)));
+		}
+
+		if (Wait && Request)
+		{
+			InFlight.Add(Request);
+		}
+	}
+	Lock.Unlock();
+
+	if (Wait)
+	{
+		// Finished requests are retired by the next load, under the lock
+		for (const TSharedPtr<IBulkDataIORequest, ESPMode::ThreadSafe>& Request : InFlight)
+		{
+			Request->WaitCompletion(0.0f);
+		}
+
+		for (int32 i = First; i <= Last; ++i)
+		{
+			if (Image.PartitionStates[i].load(std::memory_order_acquire) != static_cast<uint8>(EPartitionState::Resident))
 			{
-				Ar << CellLink.Key;
-				Ar << CellLink.Value.Row;
-				Ar << CellLink.Value.Column;
+				UE_LOG(LogAffinityTable, Error, TEXT("Could not load row partition %s of page %s on table %s"),
+					*RowIndexTags[RowPartitions[i].Begin].ToString(), *Page.GetStruct()->GetName(), *GetPathName());
 			}
 		}
 	}
 }
 
-void UAffinityTable::EnsureTagHierarchy()
+void UAffinityTable::BuildRowPartitions()
 {
-	// Tag hierarchies break if we delete non-leaf tags, leaving their children dangling. Because
-	// ATs assume tags are continuous, we must ensure the taxonomy is safe.
-	auto FindOrphans = [](TSet<FGameplayTag>& Orphans, TArray<FGameplayTag>& Tags) {
-		TSet<FGameplayTag> Tails;
-		for (const FGameplayTag& Tag : Tags)
+	RowPartitions.Reset();
+	RowPartitionIndexes.Reset();
+	RowPartitionRoots.Reset();
+	if (RowPartitionDepth <= 0)
+	{
+		return;
+	}
+
+	// Rows are saved in hierarchy order, so the rows sharing a root are contiguous
+	for (TagIndex Row = 0; Row < static_cast<TagIndex>(RowIndexTags.Num()); ++Row)
+	{
+		const FGameplayTag& Tag = RowIndexTags[Row];
+		int32 Partition = RowPartitions.Num() - 1;
+		if (Tag.IsValid())
 		{
-			FGameplayTag ParentTag = Tag.RequestDirectParent();
+			FGameplayTag Root = Tag;
+			for (int32 Depth = UGameplayTagsManager::Get().GetNumberOfTagNodes(Tag); Depth > RowPartitionDepth; --Depth)
+			{
+				Root = Root.RequestDirectParent();
+			}
 
-			bool bFoundOrphan{ false };
-			while (ParentTag.IsValid() && !bFoundOrphan)
+			const int32* FoundPartition = RowPartitionRoots.Find(Root);
+			if (!FoundPartition)
 			{
-				// If our tails contain this sequence, we are guaranteed to be continuous
-				if (Tails.Contains(ParentTag))
-				{
-					ParentTag = FGameplayTag::EmptyTag;
-				}
-				// If we know about this parent, it is safe to keep on going
-				else if (Tags.Contains(ParentTag))
-				{
-					ParentTag = ParentTag.RequestDirectParent();
-				}
-				// Otherwise this tag is broken upstream
-				else
+				Partition = RowPartitions.Add(IndexRange{ Row, Row });
+				RowPartitionRoots.Add(Root, Partition);
+			}
+			else if (*FoundPartition != Partition)
+			{
+				UE_LOG(LogAffinityTable, Warning, TEXT("Rows of %s are not contiguous on table %s, row partitions are disabled. Re-save the table to fix this."),
+					*Root.ToString(), *GetPathName());
+				RowPartitions.Reset();
+				RowPartitionIndexes.Reset();
+				RowPartitionRoots.Reset();
+				return;
+			}
+		}
+		else if (Partition == INDEX_NONE)
+		{
+			Partition = RowPartitions.Add(IndexRange{ Row, Row });
+		}
+
+		RowPartitions[Partition].End = Row + 1;
+		RowPartitionIndexes.Add(Partition);
+	}
+}
+
+int32 UAffinityTable::GetRowPartition(const FGameplayTag& InRow) const
+{
+	if (RowPartitions.Num() && InRow.IsValid())
+	{
+		FGameplayTag Root = InRow;
+		for (int32 Depth = UGameplayTagsManager::Get().GetNumberOfTagNodes(InRow); Depth > RowPartitionDepth; --Depth)
+		{
+			Root = Root.RequestDirectParent();
+		}
+		if (const int32* Partition = RowPartitionRoots.Find(Root))
+		{
+			return *Partition;
+		}
+	}
+	return INDEX_NONE;
+}
+
+void UAffinityTable::RequestRowPartition(const FGameplayTag& InRow) const
+{
+	EnsurePagesBuilt();
+
+	const int32 Partition = GetRowPartition(InRow);
+	if (Partition == INDEX_NONE)
+	{
+		return;
+	}
+
+	for (PageIndex i = 0; i < PageImages.Num(); ++i)
+	{
+		if (PageImages[i] && PageImages[i]->PartitionStates.Num())
+		{
+			// Reserve the page if needed, then start the load
+			GetResidentPage(i, 0, 0);
+			LoadRowPartitions(i, RowPartitions[Partition].Begin, RowPartitions[Partition].End, false);
+		}
+	}
+}
+
+bool UAffinityTable::IsRowPartitionResident(const FGameplayTag& InRow) const
+{
+	EnsurePagesBuilt();
+
+	const int32 Partition = GetRowPartition(InRow);
+	if (Partition == INDEX_NONE)
+	{
+		return false;
+	}
+
+	for (PageIndex i = 0; i < PageImages.Num(); ++i)
+	{
+		if (PageImages[i] && PageImages[i]->PartitionStates.Num() && !IsRowResident(i, RowPartitions[Partition].Begin, RowPartitions[Partition].End))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void UAffinityTable::ReleaseRowPartition(const FGameplayTag& InRow)
+{
+	EnsurePagesBuilt();
+
+	const int32 Partition = GetRowPartition(InRow);
+	if (Partition == INDEX_NONE)
+	{
+		return;
+	}
+
+	bool Released = false;
+	{
+		FScopeLock Lock(&PageImageLock);
+		for (PageIndex i = 0; i < PageImages.Num(); ++i)
+		{
+			PageImage* Image = PageImages[i].Get();
+			if (!Image || !Image->PartitionStates.Num() || !Image->bResident.load(std::memory_order_relaxed))
+			{
+				continue;
+			}
+
+			if (TSharedPtr<IBulkDataIORequest, ESPMode::ThreadSafe>& Request = Image->PartitionRequests[Partition])
+			{
+				Request->WaitCompletion(0.0f);
+				Request.Reset();
+			}
+			if (Image->PartitionStates[Partition].load(std::memory_order_relaxed) != static_cast<uint8>(EPartitionState::Unloaded))
+			{
+				Image->PartitionStates[Partition].store(static_cast<uint8>(EPartitionState::Unloaded), std::memory_order_release);
+				Pages[i]->DecommitDenseRows(RowPartitions[Partition].Begin, RowPartitions[Partition].End);
+				Released = true;
+			}
+		}
+	}
+
+	if (Released)
+	{
+		AdvanceEpoch();
+	}
+}
+
+void UAffinityTable::GetRowData(const TagIndex RowIndex, const UScriptStruct* InScriptStruct, TArray<uint8*>& OutData) const
+{
+	if (const FAffinityTablePage* Page = GetResidentPage(GetPageIndex(InScriptStruct), RowIndex, RowIndex + 1))
+	{
+		Page->GetDatablockPtrsForRow(RowIndex, OutData);
+	}
+}
+
+bool UAffinityTable::GetRowRange(const FGameplayTag& InTag, IndexRange& OutRange) const
+{
+	if (const IndexRange* Range = RowRanges.Find(InTag))
+	{
+		OutRange = *Range;
+		return true;
+	}
+	return false;
+}
+
+bool UAffinityTable::GetColumnRange(const FGameplayTag& InTag, IndexRange& OutRange) const
+{
+	if (const IndexRange* Range = ColumnRanges.Find(InTag))
+	{
+		OutRange = *Range;
+		return true;
+	}
+	return false;
+}
+
+bool UAffinityTable::QuerySubtree(const CellTags& InRoots, const PageIndex InPage, CellBlock& OutBlock) const
+{
+	const FAffinityTablePage* ResidentPage = GetResidentPage(InPage, 0, 0);
+	if (!ResidentPage || !ResidentPage->IsDense())
+	{
+		return false;
+	}
+
+	CellBlock Block;
+	if (GetRowRange(InRoots.Row, Block.Rows) && GetColumnRange(InRoots.Column, Block.Columns))
+	{
+		const FAffinityTablePage& Page = *GetResidentPage(InPage, Block.Rows.Begin, Block.Rows.End);
+		uint32 RowCount, ColumnCount;
+		Page.GetRowAndColumnCount(RowCount, ColumnCount);
+
+		Block.Data = Page.GetDatablockPtr(Block.Rows.Begin, Block.Columns.Begin);
+		Block.CellStride = static_cast<SIZE_T>(Page.GetCellStride());
+		Block.RowStride = Block.CellStride * ColumnCount;
+		OutBlock = Block;
+		return true;
+	}
+	return false;
+}
+
+void UAffinityTable::GetColumnData(const TagIndex ColumnIndex, const UScriptStruct* InScriptStruct, TArray<uint8*>& OutData) const
+{
+	if (const FAffinityTablePage* Page = GetPageForStruct(InScriptStruct))
+	{
+		Page->GetDatablockPtrsForColumn(ColumnIndex, OutData);
+	}
+}
+
+TConstArrayView<float> UAffinityTable::GetProjectedValues(const PageIndex InPage, const FName PropertyName) const
+{
+	EnsurePagesBuilt();
+
+	if (PageProjections.IsValidIndex(InPage) && PageProjections[InPage])
+	{
+		return PageProjections[InPage]->GetValues(PropertyName);
+	}
+	return TConstArrayView<float>();
+}
+
+TConstArrayView<float> UAffinityTable::GetProjectedRowValues(const PageIndex InPage, const FName PropertyName, const TagIndex Row) const
+{
+	EnsurePagesBuilt();
+
+	if (PageProjections.IsValidIndex(InPage) && PageProjections[InPage])
+	{
+		return PageProjections[InPage]->GetRowValues(PropertyName, Row);
+	}
+	return TConstArrayView<float>();
+}
+
+void UAffinityTable::RefreshProjections()
+{
+	EnsurePagesBuilt();
+
+	PageProjections.Reset();
+	if (!Projections.Num())
+	{
+		return;
+	}
+
+	PageProjections.SetNum(Pages.Num());
+	for (const FAffinityTableProjectionSettings& Settings : Projections)
+	{
+		if (const PageIndex Page = GetPageIndex(Settings.Structure); Page != InvalidPageIndex && Settings.Properties.Num())
+		{
+			TUniquePtr<FAffinityTablePageProjection>& Projection = PageProjections[Page];
+			Projection = MakeUnique<FAffinityTablePageProjection>();
+			Projection->Build(*GetResidentPage(Page), Settings.Properties);
+		}
+	}
+}
+
+void UAffinityTable::FindCells(const PageIndex InPage, TFunctionRef<bool(const uint8*)> Predicate, TArray<Cell>& OutCells, const CellTags* InSubtree) const
+{
+	const FAffinityTablePage* ResidentPage = GetResidentPage(InPage, 0, 0);
+	if (!ResidentPage)
+	{
+		return;
+	}
+
+	const FAffinityTablePage& Page = *ResidentPage;
+	uint32 RowCount, ColumnCount;
+	Page.GetRowAndColumnCount(RowCount, ColumnCount);
+
+	TArray<TagIndex> RowIndexes, ColumnIndexes;
+	GatherAxisIndexes(RowIndexTags, RowRanges, InSubtree ? InSubtree->Row : FGameplayTag::EmptyTag, RowCount, RowIndexes);
+	GatherAxisIndexes(ColumnIndexTags, ColumnRanges, InSubtree ? InSubtree->Column : FGameplayTag::EmptyTag, ColumnCount, ColumnIndexes);
+
+	// Row indexes are in order: load the partitions we are about to scan
+	if (RowIndexes.Num())
+	{
+		GetResidentPage(InPage, RowIndexes[0], RowIndexes.Last() + 1);
+	}
+
+	auto ScanRow = [&Page, &Predicate, &ColumnIndexes](const TagIndex Row, TArray<Cell>& OutRowCells) {
+		for (const TagIndex Column : ColumnIndexes)
+		{
+			if (const uint8* Data = Page.GetDatablockPtr(Row, Column); Data && Predicate(Data))
+			{
+				OutRowCells.Add(Cell{ Row, Column });
+			}
+		}
+	};
+
+	if (RowIndexes.Num() * ColumnIndexes.Num() >= ParallelSearchMinCells)
+	{
+		// One result array per row keeps our output in row-major order without locking
+		TArray<TArray<Cell>> RowCells;
+		RowCells.SetNum(RowIndexes.Num());
+		ParallelFor(RowIndexes.Num(), [&ScanRow, &RowIndexes, &RowCells](const int32 i) {
+			ScanRow(RowIndexes[i], RowCells[i]);
+		});
+		for (const TArray<Cell>& Cells : RowCells)
+		{
+			OutCells.Append(Cells);
+		}
+	}
+	else
+	{
+		for (const TagIndex Row : RowIndexes)
+		{
+			ScanRow(Row, OutCells);
+		}
+	}
+}
+
+bool UAffinityTable::FindCells(const PageIndex InPage, const FString& PropertyPath, const EAffinityTableComparison Comparison, const double Value, TArray<Cell>& OutCells, const CellTags* InSubtree) const
+{
+	const FAffinityTablePage* ResidentPage = GetResidentPage(InPage, 0, 0);
+	if (!ResidentPage)
+	{
+		return false;
+	}
+
+	// Resolve the property path down to a numeric property and its offset from the start of a cell
+	TArray<FString> PathSegments;
+	PropertyPath.ParseIntoArray(PathSegments, TEXT("."));
+
+	const UStruct* Struct = ResidentPage->GetStruct();
+	const FNumericProperty* NumericProperty = nullptr;
+	int32 Offset = 0;
+	for (int32 i = 0; Struct && i < PathSegments.Num(); ++i)
+	{
+		const FProperty* Property = Struct->FindPropertyByName(FName(*PathSegments[i]));
+		if (!Property)
+		{
+			break;
+		}
+		Offset += Property->GetOffset_ForInternal();
+
+		if (i == PathSegments.Num() - 1)
+		{
+			NumericProperty = CastField<FNumericProperty>(Property);
+		}
+		else
+		{
+			const FStructProperty* StructProperty = CastField<FStructProperty>(Property);
+			Struct = StructProperty ? StructProperty->Struct : nullptr;
+		}
+	}
+
+	if (!NumericProperty)
+	{
+		UE_LOG(LogAffinityTable, Error, TEXT("FindCells could not resolve %s to a numeric property on page %d of table %s"), *PropertyPath, InPage, *GetPathName());
+		return false;
+	}
+
+	const bool IsFloatingPoint = NumericProperty->IsFloatingPoint();
+	const bool IsUnsigned = NumericProperty->IsA<FByteProperty>() || NumericProperty->IsA<FUInt16Property>() || NumericProperty->IsA<FUInt32Property>() || NumericProperty->IsA<FUInt64Property>();
+	FindCells(
+		InPage, [NumericProperty, Offset, IsFloatingPoint, IsUnsigned, Comparison, Value](const uint8* Data) {
+			const uint8* ValuePtr = Data + Offset;
+			double CellValue;
+			if (IsFloatingPoint)
+			{
+				CellValue = NumericProperty->GetFloatingPointPropertyValue(ValuePtr);
+			}
+			else
+			{
+				CellValue = IsUnsigned ? static_cast<double>(NumericProperty->GetUnsignedIntPropertyValue(ValuePtr))
+									   : static_cast<double>(NumericProperty->GetSignedIntPropertyValue(ValuePtr));
+			}
+			switch (Comparison)
+			{
+				case EAffinityTableComparison::Less:
+					return CellValue < Value;
+				case EAffinityTableComparison::LessOrEqual:
+					return CellValue <= Value;
+				case EAffinityTableComparison::Equal:
+					return CellValue == Value;
+				case EAffinityTableComparison::NotEqual:
+					return CellValue != Value;
+				case EAffinityTableComparison::GreaterOrEqual:
+					return CellValue >= Value;
+				case EAffinityTableComparison::Greater:
+					return CellValue > Value;
+			}
+			return false;
+		},
+		OutCells, InSubtree);
+	return true;
+}
+
+void UAffinityTable::GatherAxisIndexes(const TArray<FGameplayTag>& InIndexTags, const TMap<FGameplayTag, IndexRange>& InRanges, const FGameplayTag& InRoot, const uint32 Count, TArray<TagIndex>& OutIndexes)
+{
+	const uint32 TagCount = FMath::Min(Count, static_cast<uint32>(InIndexTags.Num()));
+
+	// Hierarchy ordered subtrees are a contiguous range, otherwise test every tag
+	uint32 Begin = 0, End = TagCount;
+	bool TestTags = InRoot.IsValid();
+	if (const IndexRange* Range = InRoot.IsValid() ? InRanges.Find(InRoot) : nullptr)
+	{
+		Begin = Range->Begin;
+		End = FMath::Min(Range->End, TagCount);
+		TestTags = false;
+	}
+
+	OutIndexes.Reserve(End - Begin);
+	for (uint32 i = Begin; i < End; ++i)
+	{
+		if (const FGameplayTag& Tag = InIndexTags[i]; Tag.IsValid() && (!TestTags || Tag.MatchesTag(InRoot)))
+		{
+			OutIndexes.Add(i);
+		}
+	}
+}
+
+#if WITH_EDITOR
+
+void UAffinityTable::SetStructureChangeCallback(const StructureChangeCallback& InCallback)
+{
+	ChangeCallback = InCallback;
+}
+
+void UAffinityTable::SetCellsMovedCallback(const CellsMovedCallback& InCallback)
+{
+	MovedCallback = InCallback;
+}
+
+void UAffinityTable::PostEditChangeProperty(struct FPropertyChangedEvent& PropertyChangedEvent)
+{
+	EnsurePagesBuilt();
+
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+
+	// Edits inside a member (an element of Projections, say) report the inner property. We care about the member.
+	const FName PropertyName = (PropertyChangedEvent.MemberProperty != nullptr)
+								   ? PropertyChangedEvent.MemberProperty->GetFName()
+								   : NAME_None;
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(UAffinityTable, bMemoizeQueries))
+	{
+		SetQueryCacheEnabled(bMemoizeQueries);
+	}
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(UAffinityTable, Projections))
+	{
+		RefreshProjections();
+	}
+
+	// Respond to Structure changes
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(UAffinityTable, Structures))
+	{
+		static EPropertyChangeType::Type ObservedChanges = EPropertyChangeType::ValueSet | EPropertyChangeType::ArrayRemove | EPropertyChangeType::ArrayClear;
+		if (PropertyChangedEvent.ChangeType & ObservedChanges)
+		{
+			// Allocate memory for new pages. We must keep the dimensionality of other pages, which might include currently unused (deleted) rows.
+			// On the other hand, if we have no pages yet, go with the number of registered rows/columns
+			uint32 RowCount = Rows.Num();
+			uint32 ColumnCount = Columns.Num();
+			if (Pages.Num())
+			{
+				const TSharedRef<FAffinityTablePage> ExistingPage = Pages[0];
+				ExistingPage->GetRowAndColumnCount(RowCount, ColumnCount);
+			}
+
+			AllocatePageMemory(RowCount, ColumnCount);
+
+			if (ChangeCallback)
+			{
+				ChangeCallback(PropertyChangedEvent.ChangeType);
+			}
+		}
+	}
+}
+
+// The following 4 functions could be collapsed into fronts with a common add and a common delete, but
+// the gains are not much in terms of space or simplicity.
+
+bool UAffinityTable::AddRow(const FGameplayTag& InTag)
+{
+	// Missing ancestors are added too. Resolve them all at once.
+	if (AddRowTag(InTag))
+	{
+		ReleaseRetiredResolutions();
+		RebuildResolutionIndexes(true, false);
+		ResizeSavedPages();
+		RefreshProjections();
+		return true;
+	}
+	return false;
+}
+
+bool UAffinityTable::AddColumn(const FGameplayTag& InTag)
+{
+	if (AddColumnTag(InTag))
+	{
+		ReleaseRetiredResolutions();
+		RebuildResolutionIndexes(false, true);
+		ResizeSavedPages();
+		RefreshProjections();
+		return true;
+	}
+	return false;
+}
+
+bool UAffinityTable::AddRowTag(const FGameplayTag& InTag)
+{
+	// The page build reads our dimensions
+	EnsurePagesBuilt();
+	if (InTag.IsValid() && !Rows.Contains(InTag))
+	{
+		MarkPackageDirty();
+		for (const TSharedRef<FAffinityTablePage>& Page : Pages)
+		{
+			Page->AddRow();
+		}
+		AdvanceEpoch();
+		RowRanges.Empty();
+		RowIndexTags.Add(InTag);
+		Rows.Add(InTag, NextRowIndex++);
+
+		// Recursive add
+		const FGameplayTag Parent = InTag.RequestDirectParent();
+		AddRowTag(Parent);
+		return true;
+	}
+	return false;
+}
+
+bool UAffinityTable::AddColumnTag(const FGameplayTag& InTag)
+{
+	// The page build reads our dimensions
+	EnsurePagesBuilt();
+	if (InTag.IsValid() && !Columns.Contains(InTag))
+	{
+		MarkPackageDirty();
+		for (const TSharedRef<FAffinityTablePage>& Page : Pages)
+		{
+			Page->AddColumn();
+		}
+		AdvanceEpoch();
+		ColumnRanges.Empty();
+		ColumnIndexTags.Add(InTag);
+		Columns.Add(InTag, NextColumnIndex++);
+
+		const FGameplayTag Parent = InTag.RequestDirectParent();
+		AddColumnTag(Parent);
+		return true;
+	}
+	return false;
+}
+
+void UAffinityTable::DeleteRow(const FGameplayTag& InTag)
+{
+	EnsurePagesBuilt();
+	if (InTag.IsValid() && Rows.Contains(InTag))
+	{
+		MarkPackageDirty();
+		const TagIndex RowIndex = Rows[InTag];
+		for (const TSharedRef<FAffinityTablePage>& Page : Pages)
+		{
+			Page->DeleteRow(RowIndex);
+		}
+		AdvanceEpoch();
+		RowRanges.Empty();
+		Rows.Remove(InTag);
+		RowIndexTags[RowIndex] = FGameplayTag::EmptyTag;
+		if (RowColors.Contains(InTag))
+		{
+			RowColors.Remove(InTag);
+		}
+		ReleaseRetiredResolutions();
+		RebuildResolutionIndexes(true, false);
+		RefreshProjections();
+	}
+}
+
+void UAffinityTable::DeleteColumn(const FGameplayTag& InTag)
+{
+	EnsurePagesBuilt();
+	if (InTag.IsValid() && Columns.Contains(InTag))
+	{
+		MarkPackageDirty();
+		const TagIndex ColIndex = Columns[InTag];
+		for (const TSharedRef<FAffinityTablePage>& Page : Pages)
+		{
+			Page->DeleteColumn(ColIndex);
+		}
+		AdvanceEpoch();
+		ColumnRanges.Empty();
+		Columns.Remove(InTag);
+		ColumnIndexTags[ColIndex] = FGameplayTag::EmptyTag;
+		if (ColumnColors.Contains(InTag))
+		{
+			ColumnColors.Remove(InTag);
+		}
+		ReleaseRetiredResolutions();
+		RebuildResolutionIndexes(false, true);
+		RefreshProjections();
+	}
+}
+
+void UAffinityTable::SetTagColor(const FGameplayTag& InTag, const FLinearColor& Color, const bool IsRowTag)
+{
+	if (TMap<FGameplayTag, FLinearColor>& ColorMap = IsRowTag
+														 ? RowColors
+														 : ColumnColors;
+		!ColorMap.Contains(InTag))
+	{
+		ColorMap.Add(InTag, Color);
+		MarkPackageDirty();
+	}
+	else if (ColorMap[InTag] != Color)
+	{
+		ColorMap[InTag] = Color;
+		MarkPackageDirty();
+	}
+}
+
+bool UAffinityTable::TryGetTagColor(const FGameplayTag& InTag, FLinearColor& OutColor, const bool IsRowTag) const
+{
+	if (const TMap<FGameplayTag, FLinearColor>& ColorMap = IsRowTag
+															   ? RowColors
+															   : ColumnColors;
+		ColorMap.Contains(InTag))
+	{
+		OutColor = ColorMap[InTag];
+		return true;
+	}
+	return false;
+}
+
+void UAffinityTable::SetInheritanceLink(const UScriptStruct* InStruct, const CellTags& Child, const CellTags& Parent)
+{
+	check(InStruct);
+
+	InheritanceMap& Map = InheritanceMaps.FindOrAdd(InStruct->GetFName());
+	if (const FString CellID = StringIDForCell(Child);
+		!Map.Contains(CellID))
+	{
+		Map.Add(CellID, Parent);
+		MarkPackageDirty();
+	}
+	else if (Map[CellID] != Parent)
+	{
+		Map[CellID] = Parent;
+		MarkPackageDirty();
+	}
+}
+
+bool UAffinityTable::TryGetInheritanceLink(const UScriptStruct* InStruct, const CellTags& Child, CellTags& OutParent)
+{
+	check(InStruct);
+
+	InheritanceMap& Map = InheritanceMaps.FindOrAdd(InStruct->GetFName());
+	if (const FString CellID = StringIDForCell(Child);
+		Map.Contains(CellID))
+	{
+		OutParent = Map[CellID];
+		return true;
+	}
+	return false;
+}
+
+void UAffinityTable::RemoveInheritanceLink(const UScriptStruct* InStruct, const CellTags& InCell)
+{
+	check(InStruct);
+	FString CellID = StringIDForCell(InCell);
+	SetInheritanceLink(InStruct, InCell, CellTags());
+}
+
+bool UAffinityTable::AreCellsIdentical(const UScriptStruct* Struct, const Cell& CellA, const Cell& CellB) const
+{
+	if (Struct && Struct->IsValidLowLevel() && Structures.Contains(Struct))
+	{
+		const FAffinityTablePage* Page = GetPageForStruct(Struct);
+		const uint8* DataA = GetCellData(CellA, Struct);
+		const uint8* DataB = GetCellData(CellB, Struct);
+		if (Page && DataA && DataB)
+		{
+			return Page->AreCellsIdentical(DataA, DataB);
+		}
+	}
+	return false;
+}
+
+bool UAffinityTable::CopyCell(const UScriptStruct* Struct, const Cell& From, const Cell& To)
+{
+	if (Struct && Struct->IsValidLowLevel() && Structures.Contains(Struct))
+	{
+		const FAffinityTablePage* Page = GetPageForStruct(Struct);
+		const uint8* DataFrom = GetCellData(From, Struct);
+		uint8* DataTo = GetCellData(To, Struct);
+		if (Page && DataFrom && DataTo)
+		{
+			if (DataFrom != DataTo)
+			{
+				Page->CopyCell(DataTo, DataFrom);
+				MarkCellDirty(Struct, To);
+			}
+			return true;
+		}
+	}
+	return false;
+}
+
+void UAffinityTable::MarkCellDirty(const UScriptStruct* InStruct, const Cell& InCell)
+{
+	const PageIndex Page = GetPageIndex(InStruct);
+	if (!SavedPages.IsValidIndex(Page))
+	{
+		return;
+	}
+
+	SavedPage& Saved = SavedPages[Page];
+	const int32 CellIndex = static_cast<int32>(InCell.Row * Saved.Columns + InCell.Column);
+	if (InCell.Column < Saved.Columns && Saved.DirtyCells.IsValidIndex(CellIndex))
+	{
+		Saved.DirtyCells[CellIndex] = true;
+	}
+	else
+	{
+		// Not a cell we know of: serialize the whole page again
+		Saved = SavedPage();
+	}
+}
+
+uint8* UAffinityTable::GetMutableCellData(const Cell InCell, const UScriptStruct* InScriptStruct)
+{
+	uint8* Data = GetCellData(InCell, InScriptStruct);
+	if (Data)
+	{
+		MarkCellDirty(InScriptStruct, InCell);
+	}
+	return Data;
+}
+
+void UAffinityTable::ResizeSavedPages()
+{
+	for (PageIndex i = 0; i < SavedPages.Num() && i < Pages.Num(); ++i)
+	{
+		SavedPage& Saved = SavedPages[i];
+		uint32 RowCount, ColumnCount;
+		Pages[i]->GetRowAndColumnCount(RowCount, ColumnCount);
+		if (!Saved.Columns || (Saved.Columns == ColumnCount && Saved.Cells.Num() == static_cast<int32>(RowCount * ColumnCount)))
+		{
+			continue;
+		}
+
+		// Existing cells keep their records. New ones have none yet.
+		const uint32 SavedRows = Saved.Cells.Num() / Saved.Columns;
+		TArray<CellRecord> Cells;
+		Cells.SetNum(RowCount * ColumnCount);
+		TBitArray<> DirtyCells(true, RowCount * ColumnCount);
+		for (uint32 Row = 0; Row < FMath::Min(SavedRows, RowCount); ++Row)
+		{
+			for (uint32 Column = 0; Column < FMath::Min(Saved.Columns, ColumnCount); ++Column)
+			{
+				const int32 From = static_cast<int32>(Row * Saved.Columns + Column);
+				const int32 To = static_cast<int32>(Row * ColumnCount + Column);
+				Cells[To] = MoveTemp(Saved.Cells[From]);
+				DirtyCells[To] = Saved.DirtyCells[From];
+			}
+		}
+		Saved.Cells = MoveTemp(Cells);
+		Saved.DirtyCells = MoveTemp(DirtyCells);
+		Saved.Columns = ColumnCount;
+	}
+}
+
+bool UAffinityTable::IsRecordCurrent(const CellRecord& Record)
+{
+	// Objects that moved, or that the record reached through a redirector
+	if (Record.References.Num() != Record.ReferencePaths.Num())
+	{
+		return false;
+	}
+	for (int32 i = 0; i < Record.References.Num(); ++i)
+	{
+		const UObject* Object = Record.References[i].Get();
+		if (!Object || Object->GetPathName() != Record.ReferencePaths[i])
+		{
+			return false;
+		}
+	}
+
+	// Soft paths a save would redirect
+	for (const FSoftObjectPath& Path : Record.SoftReferences)
+	{
+		FSoftObjectPath SavedPath = Path;
+		if (SavedPath.PreSavePath())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void UAffinityTable::PreSaveTable()
+{
+	EnsurePagesBuilt();
+
+	// Fix-up our data: Unreal maps do not necessarily retrieve keys in insertion order. We need to store rows/cols in
+	// the exact order we want to read them later, which is hierarchy order so tag subtrees load as contiguous ranges.
+	// Pages are serialized following the same map order (see SerializePage).
+	static auto HierarchySort = [](const FGameplayTag& A, const FGameplayTag& B) { return HierarchyOrderLess(A, B); };
+	Rows.KeySort(HierarchySort);
+	Columns.KeySort(HierarchySort);
+
+	// Rows
+	Rows.GenerateKeyArray(RowTags);
+
+	// Columns
+	Columns.GenerateKeyArray(ColumnTags);
+}
+
+void UAffinityTable::SaveTable(FArchive& Ar)
+{
+	// Runtime data
+	//////////////////////////////////////////////////////////////////////////
+
+	// Format version
+	uint32 CurrentFormat = FileFormatVersion;
+	Ar << CurrentFormat;
+
+	CookedPageImages.Reset();
+
+	// Per-page data in row-major order, following insertion. Be pedantic and only save structures that have memory pages
+	// [Structure pathname, R0{data 0, ...data n}, ...Rm], ...
+	using ScriptPagePair = TPair<UScriptStruct*, FAffinityTablePage*>;
+	TArray<ScriptPagePair> StructsToSave;
+	for (UScriptStruct* Struct : Structures)
+	{
+		FAffinityTablePage* Page = GetPageForStruct(Struct);
+		if (Page && Struct)
+		{
+			ScriptPagePair Pair(Struct, Page);
+			StructsToSave.Add(Pair);
+		}
+	}
+
+	// Table directory: the location of every page and section, so they can be decoded independently. Offsets are
+	// relative to the end of the directory, and patched in once the payloads are written.
+	TArray<PageEntry> Directory;
+	for (const ScriptPagePair& Pair : StructsToSave)
+	{
+		PageEntry& Entry = Directory.AddDefaulted_GetRef();
+		Entry.StructName = Pair.Key->GetFName().ToString();
+		Entry.Footprint = Pair.Value->GetStructSize();
+
+		// Only cooked data carries raw images: editor assets stay layout independent. Editor saves write cell records,
+		// so cells that did not change are copied through.
+		Entry.Encoding = static_cast<uint8>(Ar.IsCooking() ? EPageEncoding::Cells : EPageEncoding::CellBlob);
+		if (Ar.IsCooking() && FAffinityTablePage::SupportsRawImage(Pair.Key) && !CacheLinePaddedStructures.Contains(Pair.Key))
+		{
+			Entry.Encoding = static_cast<uint8>(bLoadPagesOnDemand || bMapCookedPages ? EPageEncoding::OnDemandImage : EPageEncoding::RawImage);
+		}
+	}
+
+	int32 PagesToSave = StructsToSave.Num();
+	SectionEntry ColorsSection;
+	SectionEntry InheritanceSection;
+	auto SerializeDirectory = [&Ar, &PagesToSave, &Directory, &ColorsSection, &InheritanceSection]() {
+		Ar << PagesToSave;
+		for (PageEntry& Entry : Directory)
+		{
+			Ar << Entry;
+		}
+		Ar << ColorsSection;
+		Ar << InheritanceSection;
+	};
+
+	const int64 DirectoryPos = Ar.Tell();
+	SerializeDirectory();
+	const int64 PayloadPos = Ar.Tell();
+
+	auto BeginSection = [&Ar, PayloadPos](SectionEntry& Section) { Section.Offset = Ar.Tell() - PayloadPos; };
+	auto EndSection = [&Ar, PayloadPos](SectionEntry& Section) { Section.Size = Ar.Tell() - PayloadPos - Section.Offset; };
+
+	// Rows and columns in the order SerializePage writes them, for raw images
+	TArray<uint32> RowOrder, ColumnOrder;
+	Rows.GenerateValueArray(RowOrder);
+	Columns.GenerateValueArray(ColumnOrder);
+
+	for (int32 i = 0; i < StructsToSave.Num(); ++i)
+	{
+		const ScriptPagePair& Pair = StructsToSave[i];
+		PageEntry& Entry = Directory[i];
+		BeginSection(Entry.Section);
+
+		if (Entry.Encoding == static_cast<uint8>(EPageEncoding::RawImage) || Entry.Encoding == static_cast<uint8>(EPageEncoding::OnDemandImage))
+		{
+			uint32 LayoutHash = FAffinityTablePage::ComputeLayoutHash(Pair.Key);
+			int64 ImageSize = static_cast<int64>(RowOrder.Num()) * ColumnOrder.Num() * Entry.Footprint;
+			Ar << LayoutHash;
+			Ar << ImageSize;
+
+			if (Entry.Encoding == static_cast<uint8>(EPageEncoding::OnDemandImage))
+			{
+				// Keep the image out of our archive, so it is not read with the table
+				TArray<uint8> ImageBytes;
+				FMemoryWriter ImageWriter(ImageBytes);
+				verify(Pair.Value->SaveRawImage(ImageWriter, RowOrder, ColumnOrder) == ImageSize);
+
+				FByteBulkData& BulkData = *CookedPageImages.Add_GetRef(MakeUnique<FByteBulkData>());
+				BulkData.SetBulkDataFlags(BULKDATA_Force_NOT_InlinePayload | (bMapCookedPages ? BULKDATA_MemoryMappedPayload : 0));
+				BulkData.Lock(LOCK_READ_WRITE);
+				FMemory::Memcpy(BulkData.Realloc(ImageSize), ImageBytes.GetData(), ImageSize);
+				BulkData.Unlock();
+				BulkData.Serialize(Ar, this);
+			}
+			else
+			{
+				verify(Pair.Value->SaveRawImage(Ar, RowOrder, ColumnOrder) == ImageSize);
+			}
+
+			// Cell fallback, prefixed by its size so loaders using the image can skip it
+			int64 CellsSize = 0;
+			const int64 CellsSizePos = Ar.Tell();
+			Ar << CellsSize;
+			SaveCells(Ar, Pair.Value, Pair.Key);
+
+			const int64 CellsEndPos = Ar.Tell();
+			CellsSize = CellsEndPos - CellsSizePos - sizeof(int64);
+			Ar.Seek(CellsSizePos);
+			Ar << CellsSize;
+			Ar.Seek(CellsEndPos);
+		}
+		else if (Entry.Encoding == static_cast<uint8>(EPageEncoding::CellBlob))
+		{
+			SaveCellBlob(Ar, GetPageIndex(Pair.Key), Pair.Key);
+		}
+		else
+		{
+			SaveCells(Ar, Pair.Value, Pair.Key);
+		}
+
+		EndSection(Entry.Section);
+	}
+
+	// Editor-only data
+	//////////////////////////////////////////////////////////////////////////
+
+	// Row and column colors
+	BeginSection(ColorsSection);
+	Ar << RowColors;
+	Ar << ColumnColors;
+	EndSection(ColorsSection);
+
+	// Inheritance map:
+	// let Links(page) = [ (Key, Row, Col), ... ] for each element of Map(page)
+	// let n = PagesToSave
+	// Then, serialized maps = Page 0 { Struct name, link count, Links }, ... Page n
+	BeginSection(InheritanceSection);
+	Ar << PagesToSave;
+	for (const ScriptPagePair& Pair : StructsToSave)
+	{
+		FName StructName = Pair.Key->GetFName();
+		Ar << StructName;
+
+		int32 LinkCount = InheritanceMaps.Contains(StructName) ? InheritanceMaps[StructName].Num() : 0;
+		Ar << LinkCount;
+
+		if (LinkCount)
+		{
+			for (TPair<FString, CellTags>& CellLink : InheritanceMaps[StructName])
+			{
+				Ar << CellLink.Key;
+				Ar << CellLink.Value.Row;
+				Ar << CellLink.Value.Column;
+			}
+		}
+	}
+	EndSection(InheritanceSection);
+
+	// Patch the directory
+	const int64 EndPos = Ar.Tell();
+	Ar.Seek(DirectoryPos);
+	SerializeDirectory();
+	Ar.Seek(EndPos);
+}
+
+void UAffinityTable::RedirectTags()
+{
+	// Resolve every tag we reference once, whatever the number of rows, columns and links that use it
+	UGameplayTagsManager& Manager = UGameplayTagsManager::Get();
+	const FGameplayTagRedirectors& Redirectors = FGameplayTagRedirectors::Get();
+	TSet<FName> Resolved;
+	TMap<FName, FGameplayTag> Redirects;
+	auto Resolve = [&Manager, &Redirectors, &Resolved, &Redirects](const FName TagName) {
+		bool AlreadyResolved = false;
+		Resolved.Add(TagName, &AlreadyResolved);
+		if (AlreadyResolved || TagName.IsNone())
+		{
+			return;
+		}
+
+		if (const FGameplayTag* Redirected = Redirectors.RedirectTag(TagName))
+		{
+			Redirects.Add(TagName, *Redirected);
+			return;
+		}
+
+		// Renaming a tag leaves its children behind. Find them under the new name of their closest redirected parent.
+		if (Manager.RequestGameplayTag(TagName, false).IsValid())
+		{
+			return;
+		}
+
+		FString Parent = TagName.ToString();
+		FString Suffix;
+		int32 Separator = INDEX_NONE;
+		while (Parent.FindLastChar(TEXT('.'), Separator))
+		{
+			Suffix = Parent.Mid(Separator) + Suffix;
+			Parent.LeftInline(Separator);
+			if (const FGameplayTag* RedirectedParent = Redirectors.RedirectTag(FName(*Parent)))
+			{
+				const FGameplayTag Redirected = Manager.RequestGameplayTag(FName(RedirectedParent->ToString() + Suffix), false);
+				if (Redirected.IsValid())
 				{
-					Orphans.Add(Tag);
-					bFoundOrphan = true;
+					Redirects.Add(TagName, Redirected);
 				}
-			};
+				return;
+			}
+		}
+	};
+
+	TArray<FString> CellTagNames;
+	for (const FGameplayTag& Tag : RowTags)
+	{
+		Resolve(Tag.GetTagName());
+	}
+	for (const FGameplayTag& Tag : ColumnTags)
+	{
+		Resolve(Tag.GetTagName());
+	}
+	for (const TPair<FName, InheritanceMap>& Map : InheritanceMaps)
+	{
+		for (const TPair<FString, CellTags>& Link : Map.Value)
+		{
+			Link.Key.ParseIntoArray(CellTagNames, TEXT("|"));
+			for (const FString& TagName : CellTagNames)
+			{
+				Resolve(FName(*TagName));
+			}
+			Resolve(Link.Value.Row.GetTagName());
+			Resolve(Link.Value.Column.GetTagName());
+		}
+	}
+
+	if (!Redirects.Num())
+	{
+		return;
+	}
+
+	auto Redirect = [&Redirects](const FGameplayTag& Tag) {
+		const FGameplayTag* Redirected = Redirects.Find(Tag.GetTagName());
+		return Redirected ? *Redirected : Tag;
+	};
+	auto RedirectName = [&Redirects](const FString& TagName) {
+		const FGameplayTag* Redirected = Redirects.Find(FName(*TagName));
+		return Redirected ? Redirected->ToString() : TagName;
+	};
+
+	// Rename an axis in place: indexes and order do not change, so neither does the layout of our cells
+	auto RedirectAxis = [this, &Redirect](TArray<FGameplayTag>& Tags, TMap<FGameplayTag, TagIndex>& Map, TArray<FGameplayTag>& IndexTags,
+							TMap<FGameplayTag, FLinearColor>& Colors) {
+		TSet<FGameplayTag> Existing(Tags);
+		TMap<FGameplayTag, FGameplayTag> Renames;
+		for (FGameplayTag& Tag : Tags)
+		{
+			const FGameplayTag Redirected = Redirect(Tag);
+			if (Redirected == Tag)
+			{
+				continue;
+			}
+
+			if (Existing.Contains(Redirected))
+			{
+				UE_LOG(LogAffinityTable, Error, TEXT("The tag %s on affinity table %s redirects to %s, which the table already has. Please merge them by hand"),
+					*Tag.ToString(), *GetPathName(), *Redirected.ToString());
+				continue;
+			}
+
+			UE_LOG(LogAffinityTable, Log, TEXT("Redirecting tag %s to %s on affinity table %s"), *Tag.ToString(), *Redirected.ToString(), *GetPathName());
+			Existing.Add(Redirected);
+			Renames.Add(Tag, Redirected);
+			Tag = Redirected;
+		}
+
+		if (!Renames.Num())
+		{
+			return false;
+		}
+
+		TMap<FGameplayTag, TagIndex> RenamedMap;
+		RenamedMap.Reserve(Map.Num());
+		for (const TPair<FGameplayTag, TagIndex>& Pair : Map)
+		{
+			const FGameplayTag* Renamed = Renames.Find(Pair.Key);
+			RenamedMap.Add(Renamed ? *Renamed : Pair.Key, Pair.Value);
+		}
+		Map = MoveTemp(RenamedMap);
+
+		for (FGameplayTag& Tag : IndexTags)
+		{
+			if (const FGameplayTag* Renamed = Renames.Find(Tag))
+			{
+				Tag = *Renamed;
+			}
+		}
 
-			if (!bFoundOrphan)
+		for (const TPair<FGameplayTag, FGameplayTag>& Rename : Renames)
+		{
+			FLinearColor Color;
+			if (Colors.RemoveAndCopyValue(Rename.Key, Color))
 			{
-				Tails.Add(Tag);
+				Colors.Add(Rename.Value, Color);
 			}
 		}
+		return true;
 	};
 
+	const bool RowsRedirected = RedirectAxis(RowTags, Rows, RowIndexTags, RowColors);
+	const bool ColumnsRedirected = RedirectAxis(ColumnTags, Columns, ColumnIndexTags, ColumnColors);
+
+	bool LinksRedirected = false;
+	for (TPair<FName, InheritanceMap>& Map : InheritanceMaps)
+	{
+		InheritanceMap RenamedMap;
+		RenamedMap.Reserve(Map.Value.Num());
+		for (const TPair<FString, CellTags>& Link : Map.Value)
+		{
+			// Cell IDs hold the names of tags that may no longer exist, see StringIDForCell
+			FString Row, Column;
+			FString CellID = Link.Key;
+			if (Link.Key.Split(TEXT("|"), &Row, &Column))
+			{
+				CellID = FString::Printf(TEXT("%s|%s"), *RedirectName(Row), *RedirectName(Column));
+			}
+
+			const CellTags Parent{ Redirect(Link.Value.Row), Redirect(Link.Value.Column) };
+			LinksRedirected |= CellID != Link.Key || Parent != Link.Value;
+			RenamedMap.Add(MoveTemp(CellID), Parent);
+		}
+		Map.Value = MoveTemp(RenamedMap);
+	}
+
+	// Partitions group rows by their root tag
+	if (RowsRedirected)
+	{
+		BuildRowPartitions();
+	}
+
+	bTagsRedirected |= RowsRedirected || ColumnsRedirected || LinksRedirected;
+}
+
+void UAffinityTable::FindOrphanTags(const TArray<FGameplayTag>& Tags, TSet<FGameplayTag>& OutOrphans)
+{
+	TSet<FGameplayTag> Tails;
+	for (const FGameplayTag& Tag : Tags)
+	{
+		FGameplayTag ParentTag = Tag.RequestDirectParent();
+
+		bool bFoundOrphan{ false };
+		while (ParentTag.IsValid() && !bFoundOrphan)
+		{
+			// If our tails contain this sequence, we are guaranteed to be continuous
+			if (Tails.Contains(ParentTag))
+			{
+				ParentTag = FGameplayTag::EmptyTag;
+			}
+			// If we know about this parent, it is safe to keep on going
+			else if (Tags.Contains(ParentTag))
+			{
+				ParentTag = ParentTag.RequestDirectParent();
+			}
+			// Otherwise this tag is broken upstream
+			else
+			{
+				OutOrphans.Add(Tag);
+				bFoundOrphan = true;
+			}
+		};
+
+		if (!bFoundOrphan)
+		{
+			Tails.Add(Tag);
+		}
+	}
+}
+
+bool UAffinityTable::HasOrphanTags() const
+{
+	TSet<FGameplayTag> Orphans;
+	FindOrphanTags(RowTags, Orphans);
+	FindOrphanTags(ColumnTags, Orphans);
+	return Orphans.Num() > 0;
+}
+
+void UAffinityTable::EnsureTagHierarchy()
+{
+	// Tag hierarchies break if we delete non-leaf tags, leaving their children dangling. Because
+	// ATs assume tags are continuous, we must ensure the taxonomy is safe.
 	TSet<FGameplayTag> OrphanRows;
-	FindOrphans(OrphanRows, RowTags);
+	FindOrphanTags(RowTags, OrphanRows);
 	for (const FGameplayTag& Row : OrphanRows)
 	{
 		UE_LOG(LogAffinityTable, Error, TEXT("The row tag %s on affinity table %s has a broken hierarchy and will be deleted."
@@ -491,7 +2300,7 @@ void UAffinityTable::EnsureTagHierarchy()
 	}
 
 	TSet<FGameplayTag> OrphanColumns;
-	FindOrphans(OrphanColumns, ColumnTags);
+	FindOrphanTags(ColumnTags, OrphanColumns);
 	for (const FGameplayTag& Column : OrphanColumns)
 	{
 		UE_LOG(LogAffinityTable, Error, TEXT("The column tag %s on affinity table %s has a broken hierarchy and will be deleted."
@@ -514,22 +2323,15 @@ void UAffinityTable::LoadTable(FArchive& Ar)
 	//////////////////////////////////////////////////////////////////////////
 
 	Ar << ArchiveFormat;
+	if (ArchiveFormat < MinFileFormatVersion)
+	{
+		UE_LOG(LogAffinityTable, Error, TEXT("Unsupported file format on table %s: version (%d) cannot be converted to version (%d)"),
+			*GetPathName(), ArchiveFormat, FileFormatVersion);
+		return;
+	}
 	if (ArchiveFormat < FileFormatVersion)
 	{
 		UE_LOG(LogAffinityTable, Log, TEXT("Upgrading Affinity table %s from format version %d to latest format version (%d)"), *GetPathName(), ArchiveFormat, FileFormatVersion);
-
-		// Supported migrations
-		switch (ArchiveFormat)
-		{
-			case 3:
-				LoadTable_V3(Ar);
-				break;
-
-			default:
-				UE_LOG(LogAffinityTable, Error, TEXT("Unsupported file format on table %s: version (%d) cannot be converted to version (%d)"),
-					*GetPathName(), ArchiveFormat, FileFormatVersion);
-		}
-		return;
 	}
 
 	// Runtime data
@@ -549,69 +2351,293 @@ void UAffinityTable::LoadTable(FArchive& Ar)
 	}
 #endif
 
+	BuildRowPartitions();
+
+	if (ArchiveFormat >= 6)
+	{
+		LoadPageDirectory(Ar, ArchiveFormat);
+	}
+	else
+	{
+		LoadPageSequence(Ar, ArchiveFormat);
+	}
+
+	// Pages without a structure were skipped
+	PendingPages.RemoveAll([](const PendingPage& Pending) { return !Pending.Struct; });
+
+#if WITH_EDITOR
+	// Fixup our tags. Renames keep every row and column, so they can happen before our pages are built. Orphans are
+	// deleted once they are, see EnsureTagHierarchy.
+	RedirectTags();
+#endif
+}
+
+void UAffinityTable::LoadPageDirectory(FArchive& Ar, const uint32 Version)
+{
+	const uint32 RowCount = Rows.Num();
+	const uint32 ColCount = Columns.Num();
+
+	// Table directory
+	int32 PagesToLoad = 0;
+	Ar << PagesToLoad;
+
+	TArray<PageEntry> Directory;
+	Directory.SetNum(PagesToLoad);
+	for (PageEntry& Entry : Directory)
+	{
+		Ar << Entry;
+	}
+
+	SectionEntry ColorsSection;
+	SectionEntry InheritanceSection;
+	Ar << ColorsSection;
+	Ar << InheritanceSection;
+
+	// Directory offsets are relative to this position
+	const int64 PayloadPos = Ar.Tell();
+
+	// Capture the page images first, and leave building those pages to BuildPendingPages
+	PendingPages.SetNum(Directory.Num());
+	TArray<bool> Decode;
+	Decode.SetNumZeroed(Directory.Num());
+	for (int32 i = 0; i < Directory.Num(); ++i)
+	{
+		const PageEntry& Entry = Directory[i];
+		UScriptStruct** FoundStruct = Structures.FindByPredicate([&Entry](const UScriptStruct* Struct) { return Struct && Struct->GetFName().ToString() == Entry.StructName; });
+		if (!FoundStruct)
+		{
+			// The directory lets us skip this page and keep the rest of the table
+			UE_LOG(LogAffinityTable, Error, TEXT("The Affinity table %s does not contain the requested structure %s"), *GetPathName(), *Entry.StructName);
+			bHasLoadingErrors = true;
+			continue;
+		}
+
+		PendingPage& Pending = PendingPages[i];
+		Pending.Struct = *FoundStruct;
+		Pending.Footprint = Entry.Footprint;
+
+		Ar.Seek(PayloadPos + Entry.Section.Offset);
+		Decode[i] = !CapturePage(Ar, Pending, Entry.Encoding);
+	}
+
+	// Allocating and default-initializing cells dominates the load time of large tables. Pages are independent, so
+	// build them all at once on worker tasks. Compressed pages are built as they are decoded instead, see DecodePage.
+	ParallelFor(Directory.Num(), [this, &Decode, RowCount, ColCount](const int32 i) {
+		if (Decode[i] && !ShouldCompressPage(PendingPages[i].Struct, RowCount, ColCount))
+		{
+			PendingPages[i].Page = MakeShareable(new FAffinityTablePage(PendingPages[i].Struct, RowCount, ColCount, bFixedModeActive, true, GetCellAlignment(PendingPages[i].Struct)));
+		}
+	});
+
+	for (int32 i = 0; i < Directory.Num(); ++i)
+	{
+		if (Decode[i])
+		{
+			Ar.Seek(PayloadPos + Directory[i].Section.Offset);
+			DecodePage(Ar, PendingPages[i], Directory[i].Encoding, Version);
+		}
+	}
+
+	// Editor-only data
+	//////////////////////////////////////////////////////////////////////////
+
+	// Row and column colors
+	Ar.Seek(PayloadPos + ColorsSection.Offset);
+	Ar << RowColors;
+	Ar << ColumnColors;
+
+	// Inheritance graph
+	Ar.Seek(PayloadPos + InheritanceSection.Offset);
+	LoadInheritanceMaps(Ar);
+
+	// Leave the archive at the end of our data, regardless of what we skipped
+	Ar.Seek(PayloadPos + InheritanceSection.Offset + InheritanceSection.Size);
+}
+
+void UAffinityTable::LoadPageSequence(FArchive& Ar, const uint32 Version)
+{
 	const uint32 RowCount = Rows.Num();
 	const uint32 ColCount = Columns.Num();
 
-	int32 PagesToLoad;
-	FString StructureName;
-	int32 StructureFootprint;
+	int32 PagesToLoad = 0;
+	Ar << PagesToLoad;
+	PendingPages.SetNum(PagesToLoad);
+	for (PendingPage& Pending : PendingPages)
+	{
+		// Page headers gained a structure footprint at v4, and an encoding at v5
+		FString StructureName;
+		uint8 Encoding = static_cast<uint8>(EPageEncoding::Tagged);
+		Ar << StructureName;
+		if (Version >= 4)
+		{
+			Ar << Pending.Footprint;
+		}
+		if (Version >= 5)
+		{
+			Ar << Encoding;
+		}
+
+		UScriptStruct** FoundStruct = Structures.FindByPredicate([&StructureName](const UScriptStruct* Struct) { return Struct && Struct->GetFName().ToString() == StructureName; });
+		if (!FoundStruct)
+		{
+			// Without a directory, nothing after this page can be located
+			UE_LOG(LogAffinityTable, Error, TEXT("The Affinity table %s does not contain the requested structure %s"), *GetPathName(), *StructureName);
+			bHasLoadingErrors = true;
+			PendingPages.Empty();
+			return;
+		}
+		Pending.Struct = *FoundStruct;
+
+		const int64 PagePos = Ar.Tell();
+		if (CapturePage(Ar, Pending, Encoding))
+		{
+			// Skip the fallback that follows the image. Cell blobs came with the directory, at v8.
+			check(!Pending.Blob);
+			int64 FallbackSize = 0;
+			Ar << FallbackSize;
+			Ar.Seek(Ar.Tell() + FallbackSize);
+		}
+		else
+		{
+			Ar.Seek(PagePos);
+			DecodePage(Ar, Pending, Encoding, Version);
+		}
+	}
+
+	// Editor-only data
+	//////////////////////////////////////////////////////////////////////////
+
+	// Row and column colors
+	Ar << RowColors;
+	Ar << ColumnColors;
+
+	// Inheritance graph
+	LoadInheritanceMaps(Ar);
+}
+
+bool UAffinityTable::CapturePage(FArchive& Ar, PendingPage& Pending, const uint8 Encoding)
+{
+	// Cell blobs only need our structures, which are linked by the time BuildPendingPages runs
+	if (Encoding == static_cast<uint8>(EPageEncoding::CellBlob))
+	{
+		Pending.Blob = MakeUnique<CellBlobPayload>();
+		ReadCellBlob(Ar, *Pending.Blob);
+		return true;
+	}
+
+	if (Encoding != static_cast<uint8>(EPageEncoding::RawImage) && Encoding != static_cast<uint8>(EPageEncoding::OnDemandImage))
+	{
+		return false;
+	}
 
-	// An array to verify the footprint versions
-	TArray<int32> OldFootprints;
+	const uint32 RowCount = Rows.Num();
+	const uint32 ColCount = Columns.Num();
+	uint32 LayoutHash = 0;
+	int64 ImageSize = 0;
+	Ar << LayoutHash;
+	Ar << ImageSize;
+
+	// Raw images skip default initialization and per-cell serialization, but only apply to an identical memory layout
+	// on a dense page. Otherwise fall back to the cells that follow the image, which can only be read from this
+	// archive: structures that are not linked yet are linked now, so we can check.
+	const bool Dense = bFixedModeActive && RowCount * ColCount > 0;
+	if (Dense)
+	{
+		EnsureStructIsLoaded(Pending.Struct);
+	}
+	const bool Linked = Pending.Struct->GetStructureSize() && !Pending.Struct->HasAnyFlags(RF_NeedLoad);
+	if (!Dense || !Linked || LayoutHash != FAffinityTablePage::ComputeLayoutHash(Pending.Struct) ||
+		ImageSize != static_cast<int64>(RowCount) * ColCount * Pending.Struct->GetStructureSize())
+	{
+		return false;
+	}
 
-	// Structures and structure memory
-	Ar << PagesToLoad;
-	while (PagesToLoad)
+	if (Encoding == static_cast<uint8>(EPageEncoding::OnDemandImage))
 	{
-		Ar << StructureName;
-		Ar << StructureFootprint;
-		OldFootprints.Add(StructureFootprint);
+		// The bulk data payload lives outside of our archive, and is only read once the page is accessed
+		Pending.Image = MakeUnique<PageImage>();
+		Pending.Image->BulkData.Serialize(Ar, this, INDEX_NONE, true);
+	}
+	else
+	{
+		Pending.RawImage = static_cast<uint8*>(FMemory::Malloc(ImageSize, PLATFORM_CACHE_LINE_SIZE));
+		Ar.Serialize(Pending.RawImage, ImageSize);
 
-		UScriptStruct** FoundStruct = Structures.FindByPredicate([&StructureName](const UScriptStruct* Struct) { return Struct && Struct->GetFName().ToString() == StructureName; });
-		if (!FoundStruct)
+		// Compress right away, so we never hold more than one expanded image of a compressed page
+		if (ShouldCompressPage(Pending.Struct, RowCount, ColCount))
 		{
-			UE_LOG(LogAffinityTable, Error, TEXT("The Affinity table %s does not contain the requested structure %s"), *GetPathName(), *StructureName);
-			bHasLoadingErrors = true;
-			return;
+			Pending.Image = CompressImage(Pending.RawImage, ImageSize, Pending.Struct);
+			if (Pending.Image)
+			{
+				FMemory::Free(Pending.RawImage);
+				Pending.RawImage = nullptr;
+			}
 		}
-		UScriptStruct* ScriptStruct = *FoundStruct;
-
-		// Loading a structure is not enough to get its internals properly set-up. You may need
-		// to manually link it, with its very own linker.
-		EnsureStructIsLoaded(ScriptStruct);
+	}
+	return true;
+}
 
-		TSharedRef<FAffinityTablePage> Page(new FAffinityTablePage(ScriptStruct, RowCount, ColCount, bFixedModeActive));
-		Pages.Add(Page);
+void UAffinityTable::DecodePage(FArchive& Ar, PendingPage& Pending, const uint8 Encoding, const uint32 Version)
+{
+	const uint32 RowCount = Rows.Num();
+	const uint32 ColCount = Columns.Num();
 
-		SerializePage(Ar, &Page.Get(), ScriptStruct);
+	// Loading a structure is not enough to get its internals properly set-up. Cell data needs a linked structure
+	// right away, and preload dependencies do not cover every loader.
+	EnsureStructIsLoaded(Pending.Struct);
 
-		PagesToLoad--;
+	// Compressed pages are built right before their cells are decoded and compressed right after, so only one of
+	// them is ever expanded
+	const bool Compress = ShouldCompressPage(Pending.Struct, RowCount, ColCount);
+	if (!Pending.Page)
+	{
+		Pending.Page = MakeShareable(new FAffinityTablePage(Pending.Struct, RowCount, ColCount, bFixedModeActive, true, GetCellAlignment(Pending.Struct)));
 	}
 
-#if !UE_BUILD_SHIPPING && !UE_SERVER
-	// Verify page integrity. Do this only for dev builds, as production/final builds will contain a smaller footprint
-	// regardless, and this will create unnecessary log spam.
-	for (int i = 0; i < OldFootprints.Num(); ++i)
+	// Images we could not use are skipped, along with the size of the fallback that follows them
+	if (Encoding == static_cast<uint8>(EPageEncoding::OnDemandImage))
 	{
-		if (Pages[i]->GetStructSize() != OldFootprints[i])
-		{
-			UE_LOG(LogAffinityTable, Warning, TEXT("The structure %s footprint on AffinityTable %s changed from %d to %d since the last time it was saved, "
-												   "please ensure to re-save and submit the table to correct this and prevent unexpected data."),
-				*Pages[i]->GetStruct()->GetFName().ToString(), *GetPathName(), OldFootprints[i], Pages[i]->GetStructSize());
-		}
+		uint32 LayoutHash = 0;
+		int64 ImageSize = 0;
+		Ar << LayoutHash;
+		Ar << ImageSize;
+
+		// Skip the bulk data header and its payload
+		FByteBulkData BulkData;
+		BulkData.Serialize(Ar, this, INDEX_NONE, true);
+		Ar.Seek(Ar.Tell() + sizeof(int64));
+	}
+	else if (Encoding == static_cast<uint8>(EPageEncoding::RawImage))
+	{
+		uint32 LayoutHash = 0;
+		int64 ImageSize = 0;
+		Ar << LayoutHash;
+		Ar << ImageSize;
+		Ar.Seek(Ar.Tell() + ImageSize + sizeof(int64));
 	}
-#endif
 
-	// Editor-only data
-	//////////////////////////////////////////////////////////////////////////
+	// Image fallbacks were tagged until v8
+	check(Encoding != static_cast<uint8>(EPageEncoding::CellBlob));
+	if (Encoding == static_cast<uint8>(EPageEncoding::Tagged) || Version < 8)
+	{
+		SerializePage(Ar, Pending.Page.Get(), Pending.Struct);
+	}
+	else
+	{
+		LoadCells(Ar, Pending.Page.Get(), Pending.Struct);
+	}
 
-	// Row and column colors
-	Ar << RowColors;
-	Ar << ColumnColors;
+	if (Compress)
+	{
+		Pending.Image = CompressPage(*Pending.Page);
+	}
+}
 
-	// Inheritance graph
-	Ar << PagesToLoad;
-	while (PagesToLoad)
+void UAffinityTable::LoadInheritanceMaps(FArchive& Ar)
+{
+	int32 MapsToLoad = 0;
+	Ar << MapsToLoad;
+	while (MapsToLoad)
 	{
 		FName StructName;
 		Ar << StructName;
@@ -633,13 +2659,135 @@ void UAffinityTable::LoadTable(FArchive& Ar)
 				Map.Add(CellID, ParentCell);
 			}
 		}
-		PagesToLoad--;
+		MapsToLoad--;
 	}
+}
 
-#if WITH_EDITOR
-	// Fixup our tags
-	EnsureTagHierarchy();
+void UAffinityTable::BuildPendingPages()
+{
+	const uint32 RowCount = Rows.Num();
+	const uint32 ColCount = Columns.Num();
+
+	// Pages that Serialize did not decode hold a raw image it already checked against the structure layout, or a cell
+	// blob. Compressed blob pages are built one at a time after the rest, so only one of them is ever expanded.
+	ParallelFor(PendingPages.Num(), [this, RowCount, ColCount](const int32 i) {
+		PendingPage& Pending = PendingPages[i];
+		if (Pending.Page)
+		{
+			return;
+		}
+		if (Pending.Blob)
+		{
+			if (!ShouldCompressPage(Pending.Struct, RowCount, ColCount))
+			{
+				BuildBlobPage(Pending);
+			}
+			return;
+		}
+
+		// The page takes over the captured image, or gets its memory on first access. Compressed pages are expanded
+		// by LoadPageImage.
+		Pending.Page = MakeShareable(new FAffinityTablePage(Pending.Struct, RowCount, ColCount, bFixedModeActive, false, 0, false));
+		FAffinityTablePage& Page = *Pending.Page;
+		if (Pending.RawImage)
+		{
+			Page.AdoptDenseMemory(Pending.RawImage);
+			Pending.RawImage = nullptr;
+		}
+		else if (Pending.Image->CompressedData.Num())
+		{
+			// Compressed by Serialize
+		}
+		else if (Pending.Image->BulkData.IsDataMemoryMapped())
+		{
+			// Mapped images need no copy: point the page into the mapping, which the bulk data keeps alive. Mappings
+			// the page cannot address in place are copied, see UseExternalMemory.
+			Page.UseExternalMemory(static_cast<FStructDatablock::DatablockPtr>(const_cast<void*>(Pending.Image->BulkData.LockReadOnly())));
+			Pending.Image->BulkData.Unlock();
+			Pending.Image->bResident.store(true, std::memory_order_release);
+		}
+		else if (RowPartitions.Num())
+		{
+			Pending.Image->PartitionStates.SetNum(RowPartitions.Num());
+			for (std::atomic<uint8>& State : Pending.Image->PartitionStates)
+			{
+				State.store(static_cast<uint8>(EPartitionState::Unloaded), std::memory_order_relaxed);
+			}
+			Pending.Image->PartitionRequests.SetNum(RowPartitions.Num());
+		}
+	});
+
+	for (PendingPage& Pending : PendingPages)
+	{
+		if (Pending.Blob)
+		{
+			BuildBlobPage(Pending);
+		}
+	}
+
+#if WITH_EDITORONLY_DATA
+	SavedPages.SetNum(Pages.Num());
+#endif
+	for (PendingPage& Pending : PendingPages)
+	{
+#if !UE_BUILD_SHIPPING && !UE_SERVER
+		// Verify page integrity. Do this only for dev builds, as production/final builds will contain a smaller footprint
+		// regardless, and this will create unnecessary log spam. Tables older than v4 did not save footprints.
+		if (Pending.Footprint && Pending.Page->GetStructSize() != Pending.Footprint)
+		{
+			UE_LOG(LogAffinityTable, Warning, TEXT("The structure %s footprint on AffinityTable %s changed from %d to %d since the last time it was saved, "
+												   "please ensure to re-save and submit the table to correct this and prevent unexpected data."),
+				*Pending.Struct->GetFName().ToString(), *GetPathName(), Pending.Footprint, Pending.Page->GetStructSize());
+		}
+#endif
+
+		Pages.Add(Pending.Page.ToSharedRef());
+		PageImages.Add(MoveTemp(Pending.Image));
+#if WITH_EDITORONLY_DATA
+		SavedPages.Add(MoveTemp(Pending.Saved));
+#endif
+	}
+	PendingPages.Empty();
+
+	// Only keep image bookkeeping if we have on-demand or compressed pages, so other tables skip residency checks
+	if (!PageImages.ContainsByPredicate([](const TUniquePtr<PageImage>& Image) { return Image.IsValid(); }))
+	{
+		PageImages.Empty();
+	}
+	else if (bPrefaultMappedPages)
+	{
+		PrefaultMappedPages(false);
+	}
+
+	RebuildPageIndexes();
+	RefreshProjections();
+}
+
+void UAffinityTable::BuildBlobPage(PendingPage& Pending) const
+{
+	const uint32 RowCount = Rows.Num();
+	const uint32 ColCount = Columns.Num();
+	Pending.Page = MakeShareable(new FAffinityTablePage(Pending.Struct, RowCount, ColCount, bFixedModeActive, true, GetCellAlignment(Pending.Struct)));
+#if WITH_EDITORONLY_DATA
+	LoadCellBlob(*Pending.Blob, Pending.Page.Get(), Pending.Struct, &Pending.Saved);
+#else
+	LoadCellBlob(*Pending.Blob, Pending.Page.Get(), Pending.Struct, nullptr);
 #endif
+	Pending.Blob.Reset();
+
+	if (ShouldCompressPage(Pending.Struct, RowCount, ColCount))
+	{
+		Pending.Image = CompressPage(*Pending.Page);
+	}
+}
+
+void UAffinityTable::WaitForPageBuild() const
+{
+	// The build reads its own pages through the accessors that wait on it
+	if (PageBuildThread.load(std::memory_order_relaxed) != FPlatformTLS::GetCurrentThreadId())
+	{
+		PageBuild.Wait();
+	}
 }
 
 void UAffinityTable::GenerateRowAndColumnMaps()
@@ -662,6 +2810,7 @@ void UAffinityTable::GenerateRowAndColumnMaps()
 			continue;
 		}
 #endif
+		RowIndexTags.Add(Tag);
 		Rows.Add(Tag, NextRowIndex++);
 	}
 
@@ -671,174 +2820,640 @@ void UAffinityTable::GenerateRowAndColumnMaps()
 #if UE_BUILD_DEVELOPMENT
 		if (Columns.Contains(Tag))
 		{
-			UE_LOG(LogAffinityTable, Error, TEXT("Duplicated column tag %s found on Affinity Table %s, only the first one will be added. "
-												 "Verify the integrity of the table's information before saving and submitting to source control"),
-				*Tag.ToString(), *GetPathName());
-			bHasLoadingErrors = true;
-			continue;
+			UE_LOG(LogAffinityTable, Error, TEXT("Duplicated column tag %s found on Affinity Table %s, only the first one will be added. "
+												 "Verify the integrity of the table's information before saving and submitting to source control"),
+				*Tag.ToString(), *GetPathName());
+			bHasLoadingErrors = true;
+			continue;
+		}
+#endif
+		ColumnIndexTags.Add(Tag);
+		Columns.Add(Tag, NextColumnIndex++);
+	}
+}
+
+void UAffinityTable::ClearTable()
+{
+	// Wait for any page build before tearing down what it writes
+	EnsurePagesBuilt();
+	PendingPages.Empty();
+
+	// Destroy any existing memory pages, reset our rows, columns, and index counters.
+	// Images first: in-flight partition loads write into page memory
+	PageImages.Empty();
+	PageCacheBytes = 0;
+	Pages.Empty();
+	PageIndexes.Empty();
+	RowPartitions.Empty();
+	RowPartitionIndexes.Empty();
+	RowPartitionRoots.Empty();
+	Rows.Empty();
+	Columns.Empty();
+	RowIndexTags.Empty();
+	ColumnIndexTags.Empty();
+	Resolution.store(nullptr, std::memory_order_release);
+	Resolutions.Empty();
+	RowRanges.Empty();
+	ColumnRanges.Empty();
+	RowColors.Empty();
+	ColumnColors.Empty();
+	InheritanceMaps.Empty();
+	PageProjections.Empty();
+#if WITH_EDITORONLY_DATA
+	SavedPages.Empty();
+#endif
+
+	NextRowIndex = 0;
+	NextColumnIndex = 0;
+
+	AdvanceEpoch();
+}
+
+void UAffinityTable::Serialize(FArchive& Ar)
+{
+#if WITH_EDITOR
+	if (Ar.IsSaving())
+	{
+		PreSaveTable();
+	}
+#endif
+
+	Super::Serialize(Ar);
+
+	if (Ar.IsLoading())
+	{
+		LoadTable(Ar);
+		RebuildResolutionIndexes();
+		BuildSubtreeRanges(RowTags, RowRanges);
+		BuildSubtreeRanges(ColumnTags, ColumnRanges);
+		SetQueryCacheEnabled(bMemoizeQueries);
+
+		// Package loads build our pages in PostLoad, once our structures are linked. Anything else needs them now.
+		if (!HasAnyFlags(RF_NeedPostLoad))
+		{
+			BuildPendingPages();
+#if WITH_EDITOR
+			EnsureTagHierarchy();
+#endif
+		}
+	}
+
+#if WITH_EDITOR
+	if (Ar.IsSaving())
+	{
+		SaveTable(Ar);
+	}
+#endif
+}
+
+void UAffinityTable::SerializePage(FArchive& Ar, const FAffinityTablePage* Page, UScriptStruct* Struct)
+{
+	for (const TPair<FGameplayTag, TagIndex> Row : Rows)
+	{
+		for (const TPair<FGameplayTag, TagIndex> Column : Columns)
+		{
+			const FStructDatablock::DatablockPtr DataPtr = Page->GetDatablockPtr(Row.Value, Column.Value);
+			if (!DataPtr)
+			{
+				UE_LOG(LogAffinityTable, Error, TEXT("Missing memory location for row %s and column %s on page %s for table %s"), *Row.Key.GetTagName().ToString(), *Column.Key.GetTagName().ToString(), *Struct->GetName(), *GetPathName());
+				continue;
+			}
+			Struct->SerializeItem(Ar, DataPtr, nullptr);
+		}
+	}
+}
+
+void UAffinityTable::SaveCells(FArchive& Ar, const FAffinityTablePage* Page, UScriptStruct* Struct)
+{
+	CellSchema Schema;
+	TArray<MigrationStep> Plan;
+	BuildCellSchema(Struct, Ar, Schema, Plan);
+	Ar << Schema;
+
+	for (const TPair<FGameplayTag, TagIndex> Row : Rows)
+	{
+		for (const TPair<FGameplayTag, TagIndex> Column : Columns)
+		{
+			const FStructDatablock::DatablockPtr DataPtr = Page->GetDatablockPtr(Row.Value, Column.Value);
+			if (!DataPtr)
+			{
+				UE_LOG(LogAffinityTable, Error, TEXT("Missing memory location for row %s and column %s on page %s for table %s"), *Row.Key.GetTagName().ToString(), *Column.Key.GetTagName().ToString(), *Struct->GetName(), *GetPathName());
+				continue;
+			}
+			SerializeCell(Ar, Plan, DataPtr);
+		}
+	}
+}
+
+void UAffinityTable::LoadCells(FArchive& Ar, const FAffinityTablePage* Page, UScriptStruct* Struct)
+{
+	CellSchema Schema;
+	Ar << Schema;
+
+	// Resolve the schema once, instead of every property tag of every cell
+	TArray<MigrationStep> Plan;
+	BuildMigrationPlan(Struct, Ar, Schema, Plan);
+
+	for (const TPair<FGameplayTag, TagIndex> Row : Rows)
+	{
+		for (const TPair<FGameplayTag, TagIndex> Column : Columns)
+		{
+			const FStructDatablock::DatablockPtr DataPtr = Page->GetDatablockPtr(Row.Value, Column.Value);
+			if (!DataPtr)
+			{
+				UE_LOG(LogAffinityTable, Error, TEXT("Missing memory location for row %s and column %s on page %s for table %s"), *Row.Key.GetTagName().ToString(), *Column.Key.GetTagName().ToString(), *Struct->GetName(), *GetPathName());
+				continue;
+			}
+			SerializeCell(Ar, Plan, DataPtr);
+		}
+	}
+}
+
+void UAffinityTable::BuildCellSchema(const UScriptStruct* Struct, FArchive& Ar, CellSchema& OutSchema, TArray<MigrationStep>& OutPlan)
+{
+	OutSchema.LayoutHash = FAffinityTablePage::ComputeLayoutHash(Struct);
+	OutSchema.Properties.Reset();
+	OutPlan.Reset();
+	for (TFieldIterator<FProperty> It(Struct); It; ++It)
+	{
+		// Deprecated properties are only ever read, so loads and saves agree on the schema
+		const FProperty* Property = *It;
+		if (Property->HasAnyPropertyFlags(CPF_Deprecated) || !Property->ShouldSerializeValue(Ar))
+		{
+			continue;
+		}
+
+		SchemaProperty& Saved = OutSchema.Properties.AddDefaulted_GetRef();
+		Saved.Name = Property->GetName();
+		Saved.Type = GetSchemaType(Property);
+		Saved.ArrayDim = Property->ArrayDim;
+
+		MigrationStep& Step = OutPlan.AddDefaulted_GetRef();
+		Step.Property = Property;
+		Step.Migration = EMigration::Copy;
+		Step.ArrayDim = Property->ArrayDim;
+	}
+}
+
+bool UAffinityTable::BuildMigrationPlan(const UScriptStruct* Struct, FArchive& Ar, const CellSchema& Schema, TArray<MigrationStep>& OutPlan) const
+{
+	// An identical schema reads every property as it was written
+	CellSchema Current;
+	BuildCellSchema(Struct, Ar, Current, OutPlan);
+	if (Schema.LayoutHash == Current.LayoutHash && Schema.Properties == Current.Properties)
+	{
+		return true;
+	}
+
+	static const TMap<FString, EMigration> NumericTypes = {
+		{ TEXT("bool"), EMigration::FromBool },
+		{ TEXT("int8"), EMigration::FromInt8 },
+		{ TEXT("int16"), EMigration::FromInt16 },
+		{ TEXT("int32"), EMigration::FromInt32 },
+		{ TEXT("int64"), EMigration::FromInt64 },
+		{ TEXT("uint8"), EMigration::FromUInt8 },
+		{ TEXT("uint16"), EMigration::FromUInt16 },
+		{ TEXT("uint32"), EMigration::FromUInt32 },
+		{ TEXT("uint64"), EMigration::FromUInt64 },
+		{ TEXT("float"), EMigration::FromFloat },
+		{ TEXT("double"), EMigration::FromDouble }
+	};
+
+	// Deprecated properties still receive their values, so structures can migrate them
+	OutPlan.Reset(Schema.Properties.Num());
+	for (const SchemaProperty& Saved : Schema.Properties)
+	{
+		MigrationStep& Step = OutPlan.AddDefaulted_GetRef();
+		Step.ArrayDim = Saved.ArrayDim;
+		Step.Property = Struct->FindPropertyByName(FName(*Saved.Name));
+		if (!Step.Property)
+		{
+			// Renamed properties are found through their redirects
+			const FCoreRedirectObjectName Redirected = FCoreRedirects::GetRedirectedName(ECoreRedirectFlags::Type_Property,
+				FCoreRedirectObjectName(FName(*Saved.Name), Struct->GetFName(), Struct->GetOutermost()->GetFName()));
+			Step.Property = Struct->FindPropertyByName(Redirected.ObjectName);
+		}
+
+		if (!Step.Property || !Step.Property->ShouldSerializeValue(Ar))
+		{
+			UE_LOG(LogAffinityTable, Log, TEXT("Property %s of structure %s on AffinityTable %s is no longer serialized, its values are dropped"),
+				*Saved.Name, *Struct->GetName(), *GetPathName());
+			Step.Property = nullptr;
+			continue;
+		}
+
+		const FString Type = GetSchemaType(Step.Property);
+		const EMigration* Conversion = NumericTypes.Find(Saved.Type);
+		if (Type == Saved.Type)
+		{
+			Step.Migration = EMigration::Copy;
+		}
+		else if (Conversion && (Step.Property->IsA<FBoolProperty>() ||
+								   (Step.Property->IsA<FNumericProperty>() && !CastField<FNumericProperty>(Step.Property)->IsEnum())))
+		{
+			Step.Migration = *Conversion;
+		}
+		else
+		{
+			UE_LOG(LogAffinityTable, Warning, TEXT("Property %s of structure %s on AffinityTable %s changed from %s to %s and cannot be converted, "
+												   "its values are reset to their defaults"),
+				*Saved.Name, *Struct->GetName(), *GetPathName(), *Saved.Type, *Type);
+			Step.Property = nullptr;
+		}
+	}
+	return false;
+}
+
+void UAffinityTable::SerializeCell(FArchive& Ar, const TConstArrayView<MigrationStep> Plan, void* Data)
+{
+	for (const MigrationStep& Step : Plan)
+	{
+		// Values are prefixed by their size, so the ones we cannot read are skipped
+		int32 Size = 0;
+		const int64 SizePos = Ar.Tell();
+		Ar << Size;
+		const int64 Begin = Ar.Tell();
+
+		const int32 Count = Step.Property ? FMath::Min(Step.ArrayDim, Step.Property->ArrayDim) : 0;
+		for (int32 i = 0; i < Count && Step.Migration != EMigration::Skip; ++i)
+		{
+			void* Value = Step.Property->ContainerPtrToValuePtr<void>(Data, i);
+			if (Step.Migration == EMigration::Copy)
+			{
+				Step.Property->SerializeItem(FStructuredArchiveFromArchive(Ar).GetSlot(), Value, nullptr);
+			}
+			else
+			{
+				ConvertValue(Ar, Step.Migration, Step.Property, Value);
+			}
+		}
+
+		const int64 End = Ar.Tell();
+		if (Ar.IsSaving())
+		{
+			Size = static_cast<int32>(End - Begin);
+			Ar.Seek(SizePos);
+			Ar << Size;
+			Ar.Seek(End);
+		}
+		else if (End != Begin + Size)
+		{
+			Ar.Seek(Begin + Size);
 		}
-#endif
-		Columns.Add(Tag, NextColumnIndex++);
 	}
 }
 
-// AT's did not remember their page's structure footprint at v3
-void UAffinityTable::LoadTable_V3(FArchive& Ar)
+void UAffinityTable::ConvertValue(FArchive& Ar, const EMigration Migration, const FProperty* Property, void* Value)
 {
-	// Runtime data
-	//////////////////////////////////////////////////////////////////////////
-
-	// Populate our row and column map lookup table
-	GenerateRowAndColumnMaps();
-
-#if UE_BUILD_DEVELOPMENT
-	// Don't continue if we have errors at this point: our memory footprints will not match
-	if (bHasLoadingErrors)
+	int64 IntValue = 0;
+	double FloatValue = 0.0;
+	bool IsFloat = false;
+	switch (Migration)
 	{
-		UE_LOG(LogAffinityTable, Error, TEXT("Row or column number mismatch in affinity table %s. Cannot reload from disk. "
-											 "Please revert to a version of the table where the tags were stable, and redo modifications carefully."),
-			*GetPathName());
-		return;
+		case EMigration::FromBool:
+		case EMigration::FromUInt8:
+		{
+			uint8 Saved = 0;
+			Ar << Saved;
+			IntValue = Saved;
+			break;
+		}
+		case EMigration::FromInt8:
+		{
+			int8 Saved = 0;
+			Ar << Saved;
+			IntValue = Saved;
+			break;
+		}
+		case EMigration::FromInt16:
+		{
+			int16 Saved = 0;
+			Ar << Saved;
+			IntValue = Saved;
+			break;
+		}
+		case EMigration::FromInt32:
+		{
+			int32 Saved = 0;
+			Ar << Saved;
+			IntValue = Saved;
+			break;
+		}
+		case EMigration::FromInt64:
+		{
+			Ar << IntValue;
+			break;
+		}
+		case EMigration::FromUInt16:
+		{
+			uint16 Saved = 0;
+			Ar << Saved;
+			IntValue = Saved;
+			break;
+		}
+		case EMigration::FromUInt32:
+		{
+			uint32 Saved = 0;
+			Ar << Saved;
+			IntValue = Saved;
+			break;
+		}
+		case EMigration::FromUInt64:
+		{
+			uint64 Saved = 0;
+			Ar << Saved;
+			IntValue = static_cast<int64>(Saved);
+			break;
+		}
+		case EMigration::FromFloat:
+		{
+			float Saved = 0.0f;
+			Ar << Saved;
+			FloatValue = Saved;
+			IsFloat = true;
+			break;
+		}
+		case EMigration::FromDouble:
+		{
+			Ar << FloatValue;
+			IsFloat = true;
+			break;
+		}
+		default:
+			return;
 	}
-#endif
-
-	const uint32 RowCount = Rows.Num();
-	const uint32 ColCount = Columns.Num();
-
-	int32 PagesToLoad;
-	FString StructureName;
 
-	// Structures and structure memory
-	Ar << PagesToLoad;
-	while (PagesToLoad)
+	if (const FBoolProperty* BoolProperty = CastField<FBoolProperty>(Property))
 	{
-		Ar << StructureName;
-		UScriptStruct** FoundStruct = Structures.FindByPredicate([&StructureName](const UScriptStruct* Struct) { return Struct && Struct->GetFName().ToString() == StructureName; });
-		if (!FoundStruct)
+		BoolProperty->SetPropertyValue(Value, IsFloat ? FloatValue != 0.0 : IntValue != 0);
+	}
+	else if (const FNumericProperty* NumericProperty = CastField<FNumericProperty>(Property))
+	{
+		if (NumericProperty->IsFloatingPoint())
 		{
-			UE_LOG(LogAffinityTable, Error, TEXT("The Affinity table %s does not contain the requested structure %s"), *GetPathName(), *StructureName);
-			bHasLoadingErrors = true;
-			return;
+			NumericProperty->SetFloatingPointPropertyValue(Value, IsFloat ? FloatValue : static_cast<double>(IntValue));
+		}
+		else
+		{
+			NumericProperty->SetIntPropertyValue(Value, IsFloat ? static_cast<int64>(FloatValue) : IntValue);
 		}
-		UScriptStruct* ScriptStruct = *FoundStruct;
+	}
+}
 
-		// Loading a structure is not enough to get its internals properly set-up. You may need
-		// to manually link it, with its very own linker.
-		EnsureStructIsLoaded(ScriptStruct);
+void UAffinityTable::ReadCellBlob(FArchive& Ar, CellBlobPayload& OutBlob)
+{
+	Ar << OutBlob.Schema;
+	Ar << OutBlob.CustomVersions;
+	Ar << OutBlob.bRequiresLocalizationGather;
 
-		TSharedRef<FAffinityTablePage> Page(new FAffinityTablePage(ScriptStruct, RowCount, ColCount, bFixedModeActive));
-		Pages.Add(Page);
+	// Our archive loads the references, so the cells find their objects by path
+	Ar << OutBlob.References;
+	Ar << OutBlob.SoftReferences;
+	Ar << OutBlob.Bytes;
 
-		SerializePage(Ar, &Page.Get(), ScriptStruct);
+	OutBlob.UEVer = Ar.UEVer();
+	OutBlob.LicenseeUEVer = Ar.LicenseeUEVer();
+}
 
-		PagesToLoad--;
+void UAffinityTable::LoadCellBlob(const CellBlobPayload& Blob, const FAffinityTablePage* Page, UScriptStruct* Struct, SavedPage* OutSaved) const
+{
+	const CellSchema& Schema = Blob.Schema;
+	const TMap<FGuid, int32>& CustomVersions = Blob.CustomVersions;
+	const TArray<uint8>& Bytes = Blob.Bytes;
+
+	// Cells carry their own custom versions. The rest follows the archive they were read from.
+	FMemoryReader Reader(Bytes, true);
+	Reader.SetUEVer(Blob.UEVer);
+	Reader.SetLicenseeUEVer(Blob.LicenseeUEVer);
+	for (const TPair<FGuid, int32>& Version : CustomVersions)
+	{
+		Reader.SetCustomVersion(Version.Key, Version.Value, NAME_None);
 	}
 
-	// Editor-only data
-	//////////////////////////////////////////////////////////////////////////
+	// Objects are only loaded on the game thread. Those we reference are loaded along with our package anyway.
+	const bool LoadIfFindFails = IsInGameThread();
 
-	// Row and column colors
-	Ar << RowColors;
-	Ar << ColumnColors;
+	// Resolve the schema once, instead of every property tag of every cell
+	TArray<UObject*> CellReferences;
+	TArray<FString> CellReferencePaths;
+	TArray<FSoftObjectPath> CellSoftReferences;
+	TArray<MigrationStep> Plan;
+	const bool SameSchema = BuildMigrationPlan(Struct, Reader, Schema, Plan);
 
-	// Inheritance graph
-	Ar << PagesToLoad;
-	while (PagesToLoad)
+	// Records can be reused by saves only if they match what a save would write now
+	bool KeepRecords = OutSaved && SameSchema && Blob.UEVer == GPackageFileUEVersion && Blob.LicenseeUEVer == GPackageFileLicenseeUEVersion;
+	for (const TPair<FGuid, int32>& Version : CustomVersions)
 	{
-		FName StructName;
-		Ar << StructName;
+		const TOptional<FCustomVersion> Current = FCurrentCustomVersions::Get(Version.Key);
+		KeepRecords &= Current.IsSet() && Current->Version == Version.Value;
+	}
 
-		int32 LinkCount = 0;
-		Ar << LinkCount;
+	uint32 RowCount, ColumnCount;
+	Page->GetRowAndColumnCount(RowCount, ColumnCount);
+	if (KeepRecords)
+	{
+		OutSaved->Cells.SetNum(RowCount * ColumnCount);
+		OutSaved->DirtyCells.Init(true, RowCount * ColumnCount);
+		OutSaved->Columns = ColumnCount;
+		OutSaved->LayoutHash = Schema.LayoutHash;
+		CustomVersions.GetKeys(OutSaved->CustomVersions);
+		OutSaved->bRequiresLocalizationGather = Blob.bRequiresLocalizationGather;
+	}
 
-		if (LinkCount)
+	for (const TPair<FGameplayTag, TagIndex> Row : Rows)
+	{
+		for (const TPair<FGameplayTag, TagIndex> Column : Columns)
 		{
-			InheritanceMap& Map = InheritanceMaps.FindOrAdd(StructName);
-			FString CellID;
-			CellTags ParentCell;
+			const FStructDatablock::DatablockPtr DataPtr = Page->GetDatablockPtr(Row.Value, Column.Value);
+			if (!DataPtr)
+			{
+				UE_LOG(LogAffinityTable, Error, TEXT("Missing memory location for row %s and column %s on page %s for table %s"), *Row.Key.GetTagName().ToString(), *Column.Key.GetTagName().ToString(), *Struct->GetName(), *GetPathName());
+				continue;
+			}
 
-			for (int32 i = 0; i < LinkCount; ++i)
+			const int64 Begin = Reader.Tell();
+			CellReferences.Reset();
+			CellReferencePaths.Reset();
+			CellSoftReferences.Reset();
+			FAffinityTableCellArchive CellAr(Reader, CellReferences, CellReferencePaths, CellSoftReferences, LoadIfFindFails);
+			SerializeCell(CellAr, Plan, DataPtr);
+
+			if (KeepRecords)
 			{
-				Ar << CellID;
-				Ar << ParentCell.Row;
-				Ar << ParentCell.Column;
-				Map.Add(CellID, ParentCell);
+				const int32 CellIndex = static_cast<int32>(Row.Value * ColumnCount + Column.Value);
+				CellRecord& Record = OutSaved->Cells[CellIndex];
+				Record.Bytes.Append(Bytes.GetData() + Begin, static_cast<int32>(Reader.Tell() - Begin));
+				Record.References.Append(CellReferences);
+				Record.ReferencePaths = CellReferencePaths;
+				Record.SoftReferences = CellSoftReferences;
+				OutSaved->DirtyCells[CellIndex] = false;
 			}
 		}
-		PagesToLoad--;
 	}
-
-#if WITH_EDITOR
-	// Fixup our tags
-	EnsureTagHierarchy();
-#endif
-}
-
-void UAffinityTable::ClearTable()
-{
-	// Destroy any existing memory pages, reset our rows, columns, and index counters.
-	Pages.Empty();
-	Rows.Empty();
-	Columns.Empty();
-	RowColors.Empty();
-	ColumnColors.Empty();
-	InheritanceMaps.Empty();
-
-	NextRowIndex = 0;
-	NextColumnIndex = 0;
 }
 
-void UAffinityTable::Serialize(FArchive& Ar)
-{
 #if WITH_EDITOR
-	if (Ar.IsSaving())
+void UAffinityTable::SaveCellBlob(FArchive& Ar, const PageIndex InPage, UScriptStruct* Struct)
+{
+	const FAffinityTablePage* Page = GetResidentPage(InPage);
+	uint32 RowCount, ColumnCount;
+	Page->GetRowAndColumnCount(RowCount, ColumnCount);
+
+	// Cells are written in the schema of a persistent memory archive, like the ones that hold our records
+	TArray<uint8> SchemaBytes;
+	FMemoryWriter SchemaWriter(SchemaBytes, true);
+	CellSchema Schema;
+	TArray<MigrationStep> Plan;
+	BuildCellSchema(Struct, SchemaWriter, Schema, Plan);
+
+	SavedPages.SetNum(Pages.Num());
+	SavedPage& Saved = SavedPages[InPage];
+	if (Saved.Columns != ColumnCount || Saved.Cells.Num() != static_cast<int32>(RowCount * ColumnCount) || Saved.LayoutHash != Schema.LayoutHash)
 	{
-		PreSaveTable();
+		Saved = SavedPage();
+		Saved.Cells.SetNum(RowCount * ColumnCount);
+		Saved.DirtyCells.Init(true, RowCount * ColumnCount);
+		Saved.Columns = ColumnCount;
+		Saved.LayoutHash = Schema.LayoutHash;
 	}
-#endif
-
-	Super::Serialize(Ar);
 
-	if (Ar.IsLoading())
+	// Serialize the cells that changed since our last save, and gather what every cell references
+	TArray<UObject*> CellReferences;
+	TSet<UObject*> References;
+	TSet<FSoftObjectPath> SoftReferences;
+	int64 Size = 0;
+	for (const TPair<FGameplayTag, TagIndex> Row : Rows)
 	{
-		LoadTable(Ar);
+		for (const TPair<FGameplayTag, TagIndex> Column : Columns)
+		{
+			const FStructDatablock::DatablockPtr DataPtr = Page->GetDatablockPtr(Row.Value, Column.Value);
+			if (!DataPtr)
+			{
+				continue;
+			}
+
+			// Records that name their references by old paths are never reused, or resaving would not fix up redirectors
+			const int32 CellIndex = static_cast<int32>(Row.Value * ColumnCount + Column.Value);
+			CellRecord& Record = Saved.Cells[CellIndex];
+			if (!GAffinityTableReuseCellRecords || Saved.DirtyCells[CellIndex] || !IsRecordCurrent(Record))
+			{
+				Record.Bytes.Reset();
+				Record.ReferencePaths.Reset();
+				Record.SoftReferences.Reset();
+				CellReferences.Reset();
+
+				FMemoryWriter Writer(Record.Bytes, true);
+				FAffinityTableCellArchive CellAr(Writer, CellReferences, Record.ReferencePaths, Record.SoftReferences);
+				SerializeCell(CellAr, Plan, DataPtr);
+
+				Record.References.Reset();
+				Record.References.Append(CellReferences);
+				for (const FCustomVersion& Version : CellAr.GetCustomVersions().GetAllVersions())
+				{
+					Saved.CustomVersions.Add(Version.Key);
+				}
+				Saved.bRequiresLocalizationGather |= CellAr.RequiresLocalizationGather() || Writer.RequiresLocalizationGather();
+				Saved.DirtyCells[CellIndex] = false;
+			}
+
+			for (const TWeakObjectPtr<UObject>& Reference : Record.References)
+			{
+				if (UObject* Object = Reference.Get())
+				{
+					References.Add(Object);
+				}
+			}
+			SoftReferences.Append(Record.SoftReferences);
+			Size += Record.Bytes.Num();
+		}
 	}
 
-#if WITH_EDITOR
-	if (Ar.IsSaving())
+	TMap<FGuid, int32> CustomVersions;
+	for (const FGuid& Key : Saved.CustomVersions)
 	{
-		SaveTable(Ar);
+		if (const TOptional<FCustomVersion> Current = FCurrentCustomVersions::Get(Key))
+		{
+			CustomVersions.Add(Key, Current->Version);
+		}
+	}
+	bool RequiresLocalizationGather = Saved.bRequiresLocalizationGather;
+	TArray<UObject*> ReferenceArray = References.Array();
+	TArray<FSoftObjectPath> SoftReferenceArray = SoftReferences.Array();
+	Ar << Schema;
+	Ar << CustomVersions;
+	Ar << RequiresLocalizationGather;
+	Ar << ReferenceArray;
+	Ar << SoftReferenceArray;
+	if (RequiresLocalizationGather)
+	{
+		Ar.ThisRequiresLocalizationGather();
 	}
-#endif
-}
 
-void UAffinityTable::SerializePage(FArchive& Ar, const FAffinityTablePage* Page, UScriptStruct* Struct)
-{
+	// Cell records in the order LoadCellBlob reads them, laid out like a byte array
+	check(Size <= MAX_int32);
+	int32 ByteCount = static_cast<int32>(Size);
+	Ar << ByteCount;
 	for (const TPair<FGameplayTag, TagIndex> Row : Rows)
 	{
 		for (const TPair<FGameplayTag, TagIndex> Column : Columns)
 		{
-			const FStructDatablock::DatablockPtr DataPtr = Page->GetDatablockPtr(Row.Value, Column.Value);
-			if (!DataPtr)
+			if (Page->GetDatablockPtr(Row.Value, Column.Value))
 			{
-				UE_LOG(LogAffinityTable, Error, TEXT("Missing memory location for row %s and column %s on page %s for table %s"), *Row.Key.GetTagName().ToString(), *Column.Key.GetTagName().ToString(), *Struct->GetName(), *GetPathName());
-				continue;
+				CellRecord& Record = Saved.Cells[Row.Value * ColumnCount + Column.Value];
+				Ar.Serialize(Record.Bytes.GetData(), Record.Bytes.Num());
 			}
-			Struct->SerializeItem(Ar, DataPtr, nullptr);
 		}
 	}
 }
+#endif
 
 // Allocates space for a number of blocks, but doesn't commit cell handles.
 void UAffinityTable::AllocatePageMemory(const uint32 InRows, const uint32 InColumns)
 {
+	EnsurePagesBuilt();
+
+	// Pages are about to change: load on-demand pages for good, and copy mapped pages out of their mapping. Mapped
+	// images the page could not use in place are already copies.
+	for (PageIndex i = 0; i < PageImages.Num(); ++i)
+	{
+		if (PageImages[i] && PageImages[i]->BulkData.IsDataMemoryMapped() && Pages[i]->UsesExternalMemory())
+		{
+			FAffinityTablePage& Page = Pages[i].Get();
+			const FStructDatablock::DatablockPtr MappedData = Page.GetDatablockPtr(0, 0);
+			uint32 RowCount, ColumnCount;
+			Page.GetRowAndColumnCount(RowCount, ColumnCount);
+
+			Page.ReleaseDenseMemory();
+			Page.AllocateDenseMemory(false);
+			FMemory::Memcpy(Page.GetDatablockPtr(0, 0), MappedData, static_cast<SIZE_T>(RowCount) * ColumnCount * Page.GetStructSize());
+		}
+		else
+		{
+			GetResidentPage(i);
+		}
+	}
+	PageImages.Empty();
+	PageCacheBytes = 0;
+	RowPartitions.Empty();
+	RowPartitionIndexes.Empty();
+	RowPartitionRoots.Empty();
+
+#if WITH_EDITORONLY_DATA
+	// Saved cells follow their structure to its new page index. Only new pages start without records.
+	TMap<const UScriptStruct*, SavedPage> SavedByStruct;
+	for (PageIndex i = 0; i < SavedPages.Num() && i < Pages.Num(); ++i)
+	{
+		SavedByStruct.Add(Pages[i]->GetStruct(), MoveTemp(SavedPages[i]));
+	}
+#endif
+
 	// Add new structures
 	for (const UScriptStruct* ScriptStruct : Structures)
 	{
 		if (ScriptStruct && !GetPageForStruct(ScriptStruct))
 		{
-			TSharedRef<FAffinityTablePage> NewPage(new FAffinityTablePage(ScriptStruct, InRows, InColumns, bFixedModeActive));
-			Pages.Add(NewPage);
+			TSharedRef<FAffinityTablePage> NewPage(new FAffinityTablePage(ScriptStruct, InRows, InColumns, bFixedModeActive, true, GetCellAlignment(ScriptStruct)));
+			PageIndexes.Add(ScriptStruct, Pages.Add(NewPage));
 		}
 	}
 
@@ -851,6 +3466,21 @@ void UAffinityTable::AllocatePageMemory(const uint32 InRows, const uint32 InColu
 			PageIt.RemoveCurrent();
 		}
 	}
+
+	RebuildPageIndexes();
+#if WITH_EDITORONLY_DATA
+	SavedPages.Reset();
+	SavedPages.SetNum(Pages.Num());
+	for (PageIndex i = 0; i < Pages.Num(); ++i)
+	{
+		if (SavedPage* Saved = SavedByStruct.Find(Pages[i]->GetStruct()))
+		{
+			SavedPages[i] = MoveTemp(*Saved);
+		}
+	}
+#endif
+	AdvanceEpoch();
+	RefreshProjections();
 }
 
 FString UAffinityTable::StringIDForCell(const CellTags& InCell)
@@ -858,25 +3488,120 @@ FString UAffinityTable::StringIDForCell(const CellTags& InCell)
 	return FString::Printf(TEXT("%s|%s"), *InCell.Row.ToString(), *InCell.Column.ToString());
 }
 
-UAffinityTable::TagIndex UAffinityTable::GetIndex(const TMap<FGameplayTag, TagIndex>& InMap, const FGameplayTag& InTag, const bool ExactMatch)
+UAffinityTable::TagIndex UAffinityTable::GetIndex(const TMap<FGameplayTag, TagIndex>& InMap, const TArray<TagIndex>& InResolution, const FGameplayTag& InTag, const bool ExactMatch)
 {
 	TagIndex Index = InvalidIndex;
 	if (InTag.IsValid())
 	{
+		// Closest matches resolve in one read if our index knows about this tag. The entry already holds the exact match, if any.
+		if (!ExactMatch && InResolution.Num())
+		{
+			if (const FGameplayTagNetIndex NetIndex = UGameplayTagsManager::Get().GetNetIndexFromTag(InTag);
+				InResolution.IsValidIndex(NetIndex))
+			{
+				return InResolution[NetIndex];
+			}
+		}
+
 		// Try and find an exact match
-		if (InMap.Contains(InTag))
+		if (const TagIndex* FoundIndex = InMap.Find(InTag))
 		{
-			Index = InMap[InTag];
+			Index = *FoundIndex;
 		}
 		// Otherwise, if we allow closest match, go up one level
 		else if (!ExactMatch)
 		{
-			Index = GetIndex(InMap, InTag.RequestDirectParent(), ExactMatch);
+			Index = GetIndex(InMap, InResolution, InTag.RequestDirectParent(), ExactMatch);
 		}
 	}
 	return Index;
 }
 
+void UAffinityTable::BuildResolutionIndex(const TMap<FGameplayTag, TagIndex>& InMap, TArray<TagIndex>& OutResolution)
+{
+	OutResolution.Reset();
+
+	// Nothing to resolve against. An empty index makes queries fall back to the (equally empty) map
+	if (!InMap.Num())
+	{
+		return;
+	}
+
+	const UGameplayTagsManager& TagsManager = UGameplayTagsManager::Get();
+	FGameplayTagContainer AllTags;
+	TagsManager.RequestAllGameplayTags(AllTags, false);
+
+	// Net indexes are dense, so this is normally the final size of our index
+	OutResolution.Init(InvalidIndex, AllTags.Num() + 1);
+
+	static const TArray<TagIndex> NoResolution;
+	for (const FGameplayTag& Tag : AllTags)
+	{
+		const FGameplayTagNetIndex NetIndex = TagsManager.GetNetIndexFromTag(Tag);
+		if (NetIndex == INVALID_TAGNETINDEX)
+		{
+			continue;
+		}
+		while (NetIndex >= OutResolution.Num())
+		{
+			OutResolution.Add(InvalidIndex);
+		}
+		OutResolution[NetIndex] = GetIndex(InMap, NoResolution, Tag, false);
+	}
+}
+
+void UAffinityTable::RebuildResolutionIndexes(const bool RebuildRows, const bool RebuildColumns)
+{
+	// Build off to the side: queries keep reading the current resolution until we publish this one
+	TUniquePtr<FResolution> NewResolution = MakeUnique<FResolution>();
+	const FResolution* Current = Resolution.load(std::memory_order_acquire);
+	if (RebuildRows || !Current)
+	{
+		BuildResolutionIndex(Rows, NewResolution->Rows);
+	}
+	else
+	{
+		NewResolution->Rows = Current->Rows;
+	}
+	if (RebuildColumns || !Current)
+	{
+		BuildResolutionIndex(Columns, NewResolution->Columns);
+	}
+	else
+	{
+		NewResolution->Columns = Current->Columns;
+	}
+
+	FWriteScopeLock WriteLock(ResolutionLock);
+	Resolution.store(NewResolution.Get(), std::memory_order_release);
+	Resolutions.Add(MoveTemp(NewResolution));
+
+	// Memoized queries hold closest matches of the old tree, keyed by net indexes that may have been re-assigned. The
+	// new resolution is published first, so queries that see the new epoch resolve against it. Results resolved
+	// against the old one are stored under the old epoch, and never returned again. Cells did not move, so this is
+	// all we need.
+	Epoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void UAffinityTable::ReleaseRetiredResolutions()
+{
+	FWriteScopeLock WriteLock(ResolutionLock);
+	if (Resolutions.Num() > 1)
+	{
+		Resolutions.RemoveAt(0, Resolutions.Num() - 1);
+	}
+}
+
+void UAffinityTable::FollowTagTree()
+{
+	// Net indexes are re-assigned when the tag tree changes, so our resolution indexes must follow
+	check(IsInGameThread());
+	if (!TagTreeChangedHandle.IsValid() && !HasAnyFlags(RF_ClassDefaultObject | RF_ArchetypeObject))
+	{
+		TagTreeChangedHandle = IGameplayTagsModule::OnGameplayTagTreeChanged.AddUObject(this, &UAffinityTable::RebuildResolutionIndexes, true, true);
+	}
+}
+
 void UAffinityTable::EnsureStructIsLoaded(UScriptStruct* ScriptStruct) const
 {
 	check(ScriptStruct);
@@ -901,12 +3626,72 @@ void UAffinityTable::EnsureStructIsLoaded(UScriptStruct* ScriptStruct) const
 
 FAffinityTablePage* UAffinityTable::GetPageForStruct(const UScriptStruct* InScriptStruct) const
 {
-	if (InScriptStruct != nullptr)
+	EnsurePagesBuilt();
+
+	const PageIndex* FoundIndex = PageIndexes.Find(InScriptStruct);
+	return FoundIndex ? GetResidentPage(*FoundIndex) : nullptr;
+}
+
+void UAffinityTable::RebuildPageIndexes()
+{
+	PageIndexes.Reset();
+	for (PageIndex i = 0; i < Pages.Num(); ++i)
 	{
-		const TSharedRef<FAffinityTablePage>* RequestedPage = Pages.FindByPredicate([InScriptStruct](const TSharedRef<FAffinityTablePage>& Page) {
-			return Page->GetStruct() == InScriptStruct;
-		});
-		return RequestedPage ? &RequestedPage->Get() : nullptr;
+		PageIndexes.Add(Pages[i]->GetStruct(), i);
+	}
+}
+
+void UAffinityTable::AdvanceEpoch()
+{
+	Epoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+bool UAffinityTable::HierarchyOrderLess(const FGameplayTag& A, const FGameplayTag& B)
+{
+	// Plain string order would interleave subtrees for names that contain characters below '.', such as
+	// A, A-B, A.B. Treat the separator as the lowest possible character instead.
+	const FString NameA = A.ToString();
+	const FString NameB = B.ToString();
+	const int32 Length = FMath::Min(NameA.Len(), NameB.Len());
+	for (int32 i = 0; i < Length; ++i)
+	{
+		const TCHAR CharA = NameA[i] == TEXT('.') ? 0 : FChar::ToLower(NameA[i]);
+		const TCHAR CharB = NameB[i] == TEXT('.') ? 0 : FChar::ToLower(NameB[i]);
+		if (CharA != CharB)
+		{
+			return CharA < CharB;
+		}
+	}
+	return NameA.Len() < NameB.Len();
+}
+
+void UAffinityTable::BuildSubtreeRanges(const TArray<FGameplayTag>& InTags, TMap<FGameplayTag, IndexRange>& OutRanges)
+{
+	OutRanges.Reset();
+
+	// Tables saved before hierarchy ordering keep insertion order until they are saved again
+	for (int32 i = 1; i < InTags.Num(); ++i)
+	{
+		if (!HierarchyOrderLess(InTags[i - 1], InTags[i]))
+		{
+			return;
+		}
+	}
+
+	// Walk the tags keeping the chain of open ancestors. A subtree closes at the first tag outside of it.
+	TArray<TPair<FGameplayTag, TagIndex>, TInlineAllocator<16>> OpenTags;
+	for (int32 i = 0; i < InTags.Num(); ++i)
+	{
+		while (OpenTags.Num() && !InTags[i].MatchesTag(OpenTags.Last().Key))
+		{
+			const TPair<FGameplayTag, TagIndex> Closed = OpenTags.Pop();
+			OutRanges.Add(Closed.Key, IndexRange{ Closed.Value, static_cast<TagIndex>(i) });
+		}
+		OpenTags.Emplace(InTags[i], static_cast<TagIndex>(i));
+	}
+	while (OpenTags.Num())
+	{
+		const TPair<FGameplayTag, TagIndex> Closed = OpenTags.Pop();
+		OutRanges.Add(Closed.Key, IndexRange{ Closed.Value, static_cast<TagIndex>(InTags.Num()) });
 	}
-	return nullptr;
 }
@@ -17,14 +17,41 @@
 #include "AffinityTablePage.h"
 #include "AffinityTable.h"
 
-FAffinityTablePage::FAffinityTablePage(const UScriptStruct* InStruct, uint32 InRows, uint32 InColumns, bool InFixedMode)
+FAffinityTablePage::FAffinityTablePage(const UScriptStruct* InStruct, uint32 InRows, uint32 InColumns, bool InFixedMode, bool InInitialize, uint32 InCellAlignment, bool InAllocate)
 	: Struct(InStruct)
+	, DeletedColumns(false, InColumns)
+	, DeletedColumnCount(0)
 	, Columns(InColumns)
 	, FixedMode(InFixedMode)
-	, CurrentDatablock(0)
+	, DenseData(nullptr)
+	, DenseRows(0)
+	, DenseStructSize(0)
+	, DenseCellStride(0)
+	, CellAlignment(InCellAlignment)
+	, DatablockCapacity(0)
+	, Traits(FStructDatablock::GetStructTraits(InStruct))
+	, bExternalMemory(false)
 {
+	const uint32 BlockCount = InRows * InColumns;
+
+	// Fixed pages of a known size go in one dense block, and need no handles or rows
+	if (InFixedMode && BlockCount)
+	{
+		DenseRows = InRows;
+		DenseStructSize = static_cast<SIZE_T>(InStruct->GetStructureSize());
+		DenseCellStride = FStructDatablock::ComputeCellStride(InStruct, InCellAlignment);
+		if (InAllocate)
+		{
+			AllocateDenseMemory(InInitialize);
+		}
+		return;
+	}
+
+	// Size our datablocks for this structure
+	DatablockCapacity = FStructDatablock::ComputeCapacity(InStruct, InCellAlignment);
+
 	// Allocate memory now, if we ca;
-	if (const uint32 BlockCount = InRows * InColumns)
+	if (BlockCount)
 	{
 		AllocateBlocks(BlockCount);
 	}
@@ -48,10 +75,17 @@ FAffinityTablePage::~FAffinityTablePage()
 	{
 		delete Datablock;
 	}
+
+	if (ReservedMemory.GetVirtualPointer())
+	{
+		ReservedMemory.FreeVirtual();
+	}
 }
 
 void FAffinityTablePage::AddRow()
 {
+	check(!IsDense());
+
 	const TSharedPtr<Row> NewRow = MakeShareable(new Row);
 	AppendHandles(NewRow.Get());
 	Rows.Add(NewRow);
@@ -59,6 +93,8 @@ void FAffinityTablePage::AddRow()
 
 void FAffinityTablePage::AddColumn()
 {
+	check(!IsDense());
+
 	// Add one handle at the end of every valid row
 	for (TSharedPtr<Row>& ThisRow : Rows)
 	{
@@ -67,23 +103,24 @@ void FAffinityTablePage::AddColumn()
 			AppendHandles(ThisRow.Get(), 1);
 		}
 	}
+	DeletedColumns.Add(false);
 	Columns++;
 }
 
 void FAffinityTablePage::DeleteRow(uint32 RowIndex)
 {
+	check(!IsDense());
+
 	Row* RowToDelete = GetRow(RowIndex);
 	check(RowToDelete);
 
 	// The row itself will no longer be utilized for the duration of this editor's run, but the
 	// handles on each column will be recycled, and the memory space re-assigned as needed.
-	uint32 DatablockIndex;
-	FStructDatablock::DatablockHandle DatablockHandle;
 	for (const DataHandle Column : *RowToDelete)
 	{
-		if (GetHandleData(Column, DatablockIndex, DatablockHandle))
+		if (Column != InvalidDataHandle)
 		{
-			Datablocks[DatablockIndex]->RecycleHandle(DatablockHandle);
+			RecycleHandle(Column);
 		}
 	}
 	Rows[RowIndex].Reset();
@@ -91,29 +128,125 @@ void FAffinityTablePage::DeleteRow(uint32 RowIndex)
 
 void FAffinityTablePage::DeleteColumn(uint32 ColumnIndex)
 {
-	check(ColumnIndex < Columns && !DeletedColumns.Contains(ColumnIndex));
+	check(!IsDense());
+
+	check(ColumnIndex < Columns && !DeletedColumns[ColumnIndex]);
 
 	// Recycle one handle out of each valid row. The rows themselves remain but this column index should not be accessed again
-	uint32 DatablockIndex;
-	FStructDatablock::DatablockHandle DatablockHandle;
 	for (TSharedPtr<Row>& ThisRow : Rows)
 	{
 		if (ThisRow.IsValid())
 		{
 			check(ColumnIndex < static_cast<uint32>(ThisRow->Num()));
 			DataHandle& ThisHandle = (*ThisRow)[ColumnIndex];
-			if (GetHandleData(ThisHandle, DatablockIndex, DatablockHandle))
+			if (ThisHandle != InvalidDataHandle)
 			{
-				Datablocks[DatablockIndex]->RecycleHandle(DatablockHandle);
+				RecycleHandle(ThisHandle);
 				ThisHandle = InvalidDataHandle;
 			}
 		}
 	}
-	DeletedColumns.Add(ColumnIndex);
+	DeletedColumns[ColumnIndex] = true;
+	DeletedColumnCount++;
+}
+
+bool FAffinityTablePage::Compact()
+{
+	if (IsDense() || !Struct.IsValid())
+	{
+		return false;
+	}
+
+	// Packed cells hold consecutive handles from the first datablock on, with no datablock to spare
+	const uint32 BlockCapacity = DatablockCapacity;
+	uint32 LiveCells = 0;
+	bool Packed = true;
+	for (const TSharedPtr<Row>& ThisRow : Rows)
+	{
+		if (ThisRow.IsValid())
+		{
+			for (const DataHandle Handle : *ThisRow)
+			{
+				if (Handle != InvalidDataHandle)
+				{
+					Packed &= Handle == MakeHandle(LiveCells / BlockCapacity, LiveCells % BlockCapacity);
+					LiveCells++;
+				}
+			}
+		}
+	}
+
+	const int32 BlockCount = static_cast<int32>(FMath::DivideAndRoundUp(LiveCells, BlockCapacity));
+	if (Packed && Datablocks.Num() == BlockCount)
+	{
+		return false;
+	}
+
+	// Move every cell to its packed location. Structures are relocated bitwise, leaving the default-initialized
+	// structure of the new location behind, so the old datablocks can destroy it.
+	TArray<FStructDatablock*> Packing;
+	for (int32 i = 0; i < BlockCount; ++i)
+	{
+		Packing.Add(new FStructDatablock(Struct.Get(), BlockCapacity, true, true, CellAlignment));
+	}
+
+	const int32 StructSize = Struct->GetStructureSize();
+	uint32 Cell = 0;
+	for (TSharedPtr<Row>& ThisRow : Rows)
+	{
+		if (ThisRow.IsValid())
+		{
+			for (DataHandle& Handle : *ThisRow)
+			{
+				if (Handle != InvalidDataHandle)
+				{
+					FStructDatablock* Datablock = Packing[Cell / BlockCapacity];
+					const FStructDatablock::DatablockHandle DatablockHandle = Datablock->NewHandle();
+					check(DatablockHandle == Cell % BlockCapacity);
+					FMemory::Memswap(Datablock->GetMemoryBlock(DatablockHandle), GetDatablockPtr(Handle), StructSize);
+
+					// Handles are rewritten once the new datablocks are in place
+					Handle = Cell++;
+				}
+			}
+		}
+	}
+
+	for (const FStructDatablock* Datablock : Datablocks)
+	{
+		delete Datablock;
+	}
+	Datablocks = MoveTemp(Packing);
+
+	for (TSharedPtr<Row>& ThisRow : Rows)
+	{
+		if (ThisRow.IsValid())
+		{
+			for (DataHandle& Handle : *ThisRow)
+			{
+				if (Handle != InvalidDataHandle)
+				{
+					Handle = MakeHandle(static_cast<uint32>(Handle / BlockCapacity), static_cast<FStructDatablock::DatablockHandle>(Handle % BlockCapacity));
+				}
+			}
+		}
+	}
+
+	// Only the last datablock can have room left
+	FreeDatablocks.Reset();
+	FreeDatablockFlags.Init(false, Datablocks.Num());
+	if (Datablocks.Num() && Datablocks.Last()->HasFreeHandles())
+	{
+		FreeDatablocks.Add(Datablocks.Num() - 1);
+		FreeDatablockFlags[Datablocks.Num() - 1] = true;
+	}
+	return true;
 }
 
 FStructDatablock::DatablockPtr FAffinityTablePage::GetDatablockPtr(DataHandle Handle) const
 {
+	check(!IsDense());
+
 	uint32 DatablockIndex;
 	FStructDatablock::DatablockHandle DatablockHandle;
 	FStructDatablock::DatablockPtr DataPtr = nullptr;
@@ -124,7 +257,7 @@ FStructDatablock::DatablockPtr FAffinityTablePage::GetDatablockPtr(DataHandle Ha
 	return DataPtr;
 }
 
-FStructDatablock::DatablockPtr FAffinityTablePage::GetDatablockPtr(uint32 InRow, uint32 InColumn) const
+FStructDatablock::DatablockPtr FAffinityTablePage::GetHandleDatablockPtr(uint32 InRow, uint32 InColumn) const
 {
 	FStructDatablock::DatablockPtr Ptr = nullptr;
 	if (Row* SelectedRow = GetRow(InRow))
@@ -137,6 +270,19 @@ FStructDatablock::DatablockPtr FAffinityTablePage::GetDatablockPtr(uint32 InRow,
 
 void FAffinityTablePage::GetDatablockPtrsForRow(uint32 InRow, TArray<FStructDatablock::DatablockPtr>& OutDataBlocks) const
 {
+	// Dense rows are contiguous, and never contain invalid cells
+	if (IsDense())
+	{
+		check(InRow < DenseRows);
+		FStructDatablock::DatablockPtr Ptr = DenseData + static_cast<SIZE_T>(InRow) * Columns * DenseCellStride;
+		OutDataBlocks.Reserve(OutDataBlocks.Num() + Columns);
+		for (uint32 i = 0; i < Columns; ++i, Ptr += DenseCellStride)
+		{
+			OutDataBlocks.Add(Ptr);
+		}
+		return;
+	}
+
 	if (Row* SelectedRow = GetRow(InRow))
 	{
 		for (int i = 0; i < SelectedRow->Num(); i++)
@@ -149,9 +295,42 @@ void FAffinityTablePage::GetDatablockPtrsForRow(uint32 InRow, TArray<FStructData
 	}
 }
 
+void FAffinityTablePage::GetDatablockPtrsForColumn(uint32 InColumn, TArray<FStructDatablock::DatablockPtr>& OutDataBlocks) const
+{
+	check(InColumn < Columns);
+
+	if (IsDense())
+	{
+		const SIZE_T RowStride = static_cast<SIZE_T>(Columns) * DenseCellStride;
+		FStructDatablock::DatablockPtr Ptr = DenseData + static_cast<SIZE_T>(InColumn) * DenseCellStride;
+		OutDataBlocks.Reserve(OutDataBlocks.Num() + DenseRows);
+		for (uint32 i = 0; i < DenseRows; ++i, Ptr += RowStride)
+		{
+			OutDataBlocks.Add(Ptr);
+		}
+		return;
+	}
+
+	// Skip deleted rows, and the invalid handles of deleted columns
+	for (const TSharedPtr<Row>& ThisRow : Rows)
+	{
+		if (ThisRow.IsValid())
+		{
+			if (FStructDatablock::DatablockPtr Ptr = GetDatablockPtr((*ThisRow)[InColumn]))
+			{
+				OutDataBlocks.Add(Ptr);
+			}
+		}
+	}
+}
+
 int32 FAffinityTablePage::GetStructSize() const
 {
 	// The size of our structure is constant
+	if (IsDense())
+	{
+		return static_cast<int32>(DenseStructSize);
+	}
 	if (Datablocks.Num())
 	{
 		return Datablocks[0]->GetStructSize();
@@ -159,30 +338,295 @@ int32 FAffinityTablePage::GetStructSize() const
 	return 0;
 }
 
+int32 FAffinityTablePage::GetCellStride() const
+{
+	if (IsDense())
+	{
+		return static_cast<int32>(DenseCellStride);
+	}
+	if (Datablocks.Num())
+	{
+		return Datablocks[0]->GetCellStride();
+	}
+	return 0;
+}
+
+void FAffinityTablePage::CopyCell(const FStructDatablock::DatablockPtr Dest, const uint8* Source) const
+{
+	check(Dest && Source && Struct.IsValid());
+	if (Traits.bPlainOldData)
+	{
+		FMemory::Memcpy(Dest, Source, GetStructSize());
+	}
+	else
+	{
+		Struct->CopyScriptStruct(Dest, Source);
+	}
+}
+
+bool FAffinityTablePage::AreCellsIdentical(const uint8* CellA, const uint8* CellB) const
+{
+	check(CellA && CellB && Struct.IsValid());
+
+	// Different bits can still compare equal, like 0.0f and -0.0f, so only a match is conclusive
+	if (Traits.bPlainOldData && FMemory::Memcmp(CellA, CellB, GetStructSize()) == 0)
+	{
+		return true;
+	}
+	return Struct->CompareScriptStruct(CellA, CellB, PPF_DeepComparison);
+}
+
+void FAffinityTablePage::GetMemoryStats(MemoryStats& OutStats) const
+{
+	OutStats = MemoryStats();
+	OutStats.Datablocks = Datablocks.Num();
+	OutStats.DatablockCapacity = IsDense() ? DenseRows * Columns : DatablockCapacity;
+	for (const FStructDatablock* Datablock : Datablocks)
+	{
+		OutStats.OSDatablocks += Datablock->IsAllocatedFromOS() ? 1 : 0;
+		OutStats.AllocatedBytes += Datablock->GetAllocatedSize();
+	}
+
+	// Only cells in our own memory count
+	if (IsDense())
+	{
+		OutStats.CellBytes = Datablocks.Num() ? static_cast<SIZE_T>(DenseRows) * Columns * DenseStructSize : 0;
+		return;
+	}
+
+	SIZE_T LiveCells = 0;
+	for (const TSharedPtr<Row>& ThisRow : Rows)
+	{
+		if (ThisRow.IsValid())
+		{
+			for (const DataHandle Handle : *ThisRow)
+			{
+				LiveCells += Handle != InvalidDataHandle ? 1 : 0;
+			}
+		}
+	}
+	OutStats.CellBytes = LiveCells * GetStructSize();
+}
+
+void FAffinityTablePage::ReleaseDenseMemory()
+{
+	check(IsDense());
+	for (const FStructDatablock* Datablock : Datablocks)
+	{
+		delete Datablock;
+	}
+	Datablocks.Empty();
+	DenseData = nullptr;
+	bExternalMemory = false;
+
+	if (ReservedMemory.GetVirtualPointer())
+	{
+		ReservedMemory.FreeVirtual();
+		ReservedMemory = FPlatformMemory::FPlatformVirtualMemoryBlock();
+	}
+}
+
+void FAffinityTablePage::AllocateDenseMemory(const bool InInitialize)
+{
+	check(IsDense() && !DenseData);
+	FStructDatablock* Datablock = new FStructDatablock(Struct.Get(), DenseRows * Columns, true, InInitialize, CellAlignment);
+	Datablocks.Add(Datablock);
+	DenseData = Datablock->GetMemoryBlock(0);
+}
+
+bool FAffinityTablePage::UseExternalMemory(const FStructDatablock::DatablockPtr InMemory)
+{
+	check(IsDense() && !DenseData && InMemory);
+	if (DenseCellStride == DenseStructSize && IsAligned(InMemory, FStructDatablock::ComputeAlignment(Struct.Get(), CellAlignment)))
+	{
+		DenseData = InMemory;
+		bExternalMemory = true;
+		return true;
+	}
+
+	// Archives only guarantee the alignment of the payload start. Copy, one cell at a time if ours are padded.
+	AllocateDenseMemory(false);
+	const SIZE_T CellCount = static_cast<SIZE_T>(DenseRows) * Columns;
+	if (DenseCellStride == DenseStructSize)
+	{
+		FMemory::Memcpy(DenseData, InMemory, CellCount * DenseStructSize);
+	}
+	else
+	{
+		for (SIZE_T i = 0; i < CellCount; ++i)
+		{
+			FMemory::Memcpy(DenseData + i * DenseCellStride, InMemory + i * DenseStructSize, DenseStructSize);
+		}
+	}
+	return false;
+}
+
+void FAffinityTablePage::AdoptDenseMemory(const FStructDatablock::DatablockPtr InMemory)
+{
+	check(IsDense() && !DenseData && InMemory);
+	FStructDatablock* Datablock = new FStructDatablock(Struct.Get(), DenseRows * Columns, false, true, CellAlignment);
+	Datablock->Adopt(InMemory);
+	Datablocks.Add(Datablock);
+	DenseData = Datablock->GetMemoryBlock(0);
+}
+
+void FAffinityTablePage::ReserveDenseMemory()
+{
+	check(IsDense() && !DenseData && DenseCellStride == DenseStructSize);
+	ReservedMemory = FPlatformMemory::FPlatformVirtualMemoryBlock::AllocateVirtual(static_cast<SIZE_T>(DenseRows) * Columns * DenseStructSize);
+	DenseData = static_cast<FStructDatablock::DatablockPtr>(ReservedMemory.GetVirtualPointer());
+}
+
+void FAffinityTablePage::CommitDenseRows(const uint32 RowBegin, const uint32 RowEnd)
+{
+	check(ReservedMemory.GetVirtualPointer() && RowBegin <= RowEnd && RowEnd <= DenseRows);
+	const SIZE_T RowSize = Columns * DenseStructSize;
+	const SIZE_T Alignment = FPlatformMemory::FPlatformVirtualMemoryBlock::GetCommitAlignment();
+
+	// Round outwards: we may commit a bit of our neighbours, which is harmless
+	const SIZE_T Begin = AlignDown(RowBegin * RowSize, Alignment);
+	const SIZE_T End = Align(RowEnd * RowSize, Alignment);
+	if (End > Begin)
+	{
+		ReservedMemory.Commit(Begin, End - Begin);
+	}
+}
+
+void FAffinityTablePage::DecommitDenseRows(const uint32 RowBegin, const uint32 RowEnd)
+{
+	check(ReservedMemory.GetVirtualPointer() && RowBegin <= RowEnd && RowEnd <= DenseRows);
+	const SIZE_T RowSize = Columns * DenseStructSize;
+	const SIZE_T Alignment = FPlatformMemory::FPlatformVirtualMemoryBlock::GetCommitAlignment();
+
+	// Round inwards: memory shared with neighbouring rows may still be in use
+	const SIZE_T Begin = Align(RowBegin * RowSize, Alignment);
+	const SIZE_T End = AlignDown(RowEnd * RowSize, Alignment);
+	if (End > Begin)
+	{
+		ReservedMemory.Decommit(Begin, End - Begin);
+	}
+}
+
+bool FAffinityTablePage::LoadRawImage(FArchive& Ar, const int64 ImageSize)
+{
+	if (!IsDense() || !DenseData || ImageSize != static_cast<int64>(DenseRows) * Columns * DenseStructSize)
+	{
+		return false;
+	}
+
+	// Padded cells are read one at a time
+	if (DenseCellStride == DenseStructSize)
+	{
+		Ar.Serialize(DenseData, ImageSize);
+	}
+	else
+	{
+		const SIZE_T CellCount = static_cast<SIZE_T>(DenseRows) * Columns;
+		for (SIZE_T i = 0; i < CellCount; ++i)
+		{
+			Ar.Serialize(DenseData + i * DenseCellStride, DenseStructSize);
+		}
+	}
+	return true;
+}
+
+int64 FAffinityTablePage::SaveRawImage(FArchive& Ar, const TArray<uint32>& InRows, const TArray<uint32>& InColumns) const
+{
+	const int64 CellSize = GetStructSize();
+	int64 ImageSize = 0;
+	for (const uint32 RowIndex : InRows)
+	{
+		for (const uint32 ColumnIndex : InColumns)
+		{
+			FStructDatablock::DatablockPtr DataPtr = GetDatablockPtr(RowIndex, ColumnIndex);
+			check(DataPtr);
+			Ar.Serialize(DataPtr, CellSize);
+			ImageSize += CellSize;
+		}
+	}
+	return ImageSize;
+}
+
+bool FAffinityTablePage::SupportsRawImage(const UScriptStruct* InStruct)
+{
+	if (!InStruct || InStruct->StructFlags & STRUCT_SerializeNative)
+	{
+		return false;
+	}
+
+	// Native state outside of reflected properties would be copied blindly. Make sure properties cover the whole structure.
+	int32 PropertyExtent = 0;
+	for (TFieldIterator<FProperty> It(InStruct); It; ++It)
+	{
+		const FProperty* Property = *It;
+		if (const FStructProperty* StructProperty = CastField<FStructProperty>(Property))
+		{
+			if (!SupportsRawImage(StructProperty->Struct))
+			{
+				return false;
+			}
+		}
+		else if (!Property->IsA<FNumericProperty>() && !Property->IsA<FBoolProperty>() && !Property->IsA<FEnumProperty>())
+		{
+			return false;
+		}
+		PropertyExtent = FMath::Max(PropertyExtent, Property->GetOffset_ForInternal() + Property->GetSize());
+	}
+	return Align(PropertyExtent, FMath::Max(InStruct->GetMinAlignment(), 1)) == InStruct->GetStructureSize();
+}
+
+uint32 FAffinityTablePage::ComputeLayoutHash(const UScriptStruct* InStruct)
+{
+	check(InStruct);
+
+	uint32 Hash = GetTypeHash(InStruct->GetStructureSize());
+	for (TFieldIterator<FProperty> It(InStruct); It; ++It)
+	{
+		const FProperty* Property = *It;
+		Hash = HashCombine(Hash, GetTypeHash(Property->GetFName().ToString()));
+		Hash = HashCombine(Hash, GetTypeHash(Property->GetClass()->GetFName().ToString()));
+		Hash = HashCombine(Hash, GetTypeHash(Property->GetOffset_ForInternal()));
+		Hash = HashCombine(Hash, GetTypeHash(Property->GetSize()));
+		if (const FStructProperty* StructProperty = CastField<FStructProperty>(Property))
+		{
+			Hash = HashCombine(Hash, ComputeLayoutHash(StructProperty->Struct));
+		}
+	}
+	return Hash;
+}
+
 void FAffinityTablePage::AllocateBlocks(uint32 Capacity)
 {
-	check(Capacity);
-	check(Struct.IsValid());
+	check(Struct.IsValid() && DatablockCapacity);
+	if (!Capacity)
+	{
+		Capacity = DatablockCapacity;
+	}
 
-	uint32 FullBlocks = Capacity / FStructDatablock::MaxDatablockCapacity;
-	const uint32 SmallBlock = Capacity % FStructDatablock::MaxDatablockCapacity;
+	uint32 FullBlocks = Capacity / DatablockCapacity;
+	const uint32 SmallBlock = Capacity % DatablockCapacity;
 
 	// This function always adds at least one datablock.
-	// Move the current datablock to the first new added set.
-	CurrentDatablock = Datablocks.Num();
-
+	// New datablocks are handed out in order, so push them in reverse.
+	const int32 FirstDatablock = Datablocks.Num();
 	while (FullBlocks)
 	{
-		FStructDatablock* Datablock = new FStructDatablock(Struct.Get(), FStructDatablock::MaxDatablockCapacity, true);
+		FStructDatablock* Datablock = new FStructDatablock(Struct.Get(), DatablockCapacity, true, true, CellAlignment);
 		Datablocks.Add(Datablock);
 		--FullBlocks;
 	}
 
 	if (SmallBlock)
 	{
-		FStructDatablock* Datablock = new FStructDatablock(Struct.Get(), SmallBlock, true);
+		FStructDatablock* Datablock = new FStructDatablock(Struct.Get(), SmallBlock, true, true, CellAlignment);
 		Datablocks.Add(Datablock);
 	}
+
+	FreeDatablockFlags.Add(true, Datablocks.Num() - FirstDatablock);
+	for (int32 i = Datablocks.Num() - 1; i >= FirstDatablock; --i)
+	{
+		FreeDatablocks.Add(static_cast<uint32>(i));
+	}
 }
 
 void FAffinityTablePage::AppendHandles(Row* InRow, uint32 Count)
@@ -190,7 +634,7 @@ void FAffinityTablePage::AppendHandles(Row* InRow, uint32 Count)
 	check(InRow);
 
 	// Minor speed-up if we have no deleted columns (will happen during the game)
-	if (!Count && !DeletedColumns.Num())
+	if (!Count && !DeletedColumnCount)
 	{
 		Count = Columns;
 	}
@@ -210,7 +654,7 @@ void FAffinityTablePage::AppendHandles(Row* InRow, uint32 Count)
 	{
 		for (uint32 i = 0; i < Columns; ++i)
 		{
-			InRow->Add(DeletedColumns.Contains(i) ? InvalidDataHandle : NewHandle());
+			InRow->Add(DeletedColumns[i] ? InvalidDataHandle : NewHandle());
 		}
 	}
 }
@@ -241,31 +685,38 @@ bool FAffinityTablePage::GetHandleData(DataHandle Handle, uint32& OutDatablockIn
 
 FAffinityTablePage::DataHandle FAffinityTablePage::FindAvailableHandle()
 {
-	DataHandle Handle = InvalidDataHandle;
-	if (Datablocks.Num())
+	// Only datablocks with free handles are on the stack, so this takes constant time
+	while (FreeDatablocks.Num())
 	{
-		FStructDatablock* Datablock = Datablocks[CurrentDatablock];
-		FStructDatablock::DatablockHandle DatablockHandle = Datablock->NewHandle();
-		if (DatablockHandle == FStructDatablock::InvalidHandle)
+		const uint32 DatablockIndex = FreeDatablocks.Last();
+		FStructDatablock* Datablock = Datablocks[DatablockIndex];
+		const FStructDatablock::DatablockHandle DatablockHandle = Datablock->NewHandle();
+		if (!Datablock->HasFreeHandles())
 		{
-			for (int32 i = 0; i < Datablocks.Num(); ++i)
-			{
-				Datablock = Datablocks[i];
-				DatablockHandle = Datablock->NewHandle();
-				if (DatablockHandle != FStructDatablock::InvalidHandle)
-				{
-					CurrentDatablock = static_cast<uint32>(i);
-					Handle = MakeHandle(CurrentDatablock, DatablockHandle);
-					break;
-				}
-			}
+			FreeDatablocks.Pop();
+			FreeDatablockFlags[DatablockIndex] = false;
 		}
-		else
+
+		if (DatablockHandle != FStructDatablock::InvalidHandle)
 		{
-			Handle = MakeHandle(CurrentDatablock, DatablockHandle);
+			return MakeHandle(DatablockIndex, DatablockHandle);
 		}
 	}
-	return Handle;
+	return InvalidDataHandle;
+}
+
+void FAffinityTablePage::RecycleHandle(const DataHandle Handle)
+{
+	uint32 DatablockIndex;
+	FStructDatablock::DatablockHandle DatablockHandle;
+	verify(GetHandleData(Handle, DatablockIndex, DatablockHandle));
+	Datablocks[DatablockIndex]->RecycleHandle(DatablockHandle);
+
+	if (!FreeDatablockFlags[DatablockIndex])
+	{
+		FreeDatablocks.Add(DatablockIndex);
+		FreeDatablockFlags[DatablockIndex] = true;
+	}
 }
 
 FAffinityTablePage::DataHandle FAffinityTablePage::NewHandle()
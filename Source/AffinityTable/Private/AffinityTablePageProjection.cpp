@@ -0,0 +1,86 @@
+/**
+ * Copyright 2024 Inflexion Games. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AffinityTablePageProjection.h"
+#include "AffinityTable.h"
+#include "AffinityTablePage.h"
+
+void FAffinityTablePageProjection::Build(const FAffinityTablePage& Page, const TArray<FName>& PropertyNames)
+{
+	Values.Empty(PropertyNames.Num());
+	Page.GetRowAndColumnCount(Rows, Columns);
+
+	const UScriptStruct* Struct = Page.GetStruct();
+	if (!Struct)
+	{
+		return;
+	}
+
+	for (const FName& PropertyName : PropertyNames)
+	{
+		const FNumericProperty* Property = CastField<FNumericProperty>(Struct->FindPropertyByName(PropertyName));
+		if (!Property || Property->ArrayDim != 1)
+		{
+			UE_LOG(LogAffinityTable, Warning, TEXT("Cannot project property %s of structure %s: only single numeric properties are supported"),
+				*PropertyName.ToString(), *Struct->GetName());
+			continue;
+		}
+
+		ValueArray& PropertyValues = Values.Add(PropertyName);
+		PropertyValues.SetNumZeroed(static_cast<int32>(Rows * Columns));
+
+		const bool IsFloatingPoint = Property->IsFloatingPoint();
+		const bool IsUnsigned = Property->IsA<FByteProperty>() || Property->IsA<FUInt16Property>() || Property->IsA<FUInt32Property>() || Property->IsA<FUInt64Property>();
+		float* Out = PropertyValues.GetData();
+		for (uint32 Row = 0; Row < Rows; ++Row)
+		{
+			for (uint32 Column = 0; Column < Columns; ++Column, ++Out)
+			{
+				if (const uint8* CellData = Page.GetDatablockPtr(Row, Column))
+				{
+					const void* ValuePtr = Property->ContainerPtrToValuePtr<void>(CellData);
+					if (IsFloatingPoint)
+					{
+						*Out = static_cast<float>(Property->GetFloatingPointPropertyValue(ValuePtr));
+					}
+					else
+					{
+						*Out = IsUnsigned ? static_cast<float>(Property->GetUnsignedIntPropertyValue(ValuePtr))
+										  : static_cast<float>(Property->GetSignedIntPropertyValue(ValuePtr));
+					}
+				}
+			}
+		}
+	}
+}
+
+TConstArrayView<float> FAffinityTablePageProjection::GetValues(const FName PropertyName) const
+{
+	if (const ValueArray* PropertyValues = Values.Find(PropertyName))
+	{
+		return MakeArrayView(PropertyValues->GetData(), PropertyValues->Num());
+	}
+	return TConstArrayView<float>();
+}
+
+TConstArrayView<float> FAffinityTablePageProjection::GetRowValues(const FName PropertyName, const uint32 Row) const
+{
+	if (const ValueArray* PropertyValues = Values.Find(PropertyName); PropertyValues && Row < Rows)
+	{
+		return MakeArrayView(PropertyValues->GetData() + static_cast<SIZE_T>(Row) * Columns, static_cast<int32>(Columns));
+	}
+	return TConstArrayView<float>();
+}
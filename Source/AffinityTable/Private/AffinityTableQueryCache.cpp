@@ -0,0 +1,67 @@
+/**
+ * Copyright 2024 Inflexion Games. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AffinityTableQueryCache.h"
+
+bool FAffinityTableQueryCache::Find(const uint64 Key, const uint32 Epoch, TFunctionRef<void(const FEntry&)> OnFound) const
+{
+	{
+		FReadScopeLock ReadLock(Lock);
+		if (CacheEpoch == Epoch)
+		{
+			if (const FEntry* Entry = Entries.Find(Key))
+			{
+				OnFound(*Entry);
+				Hits.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+	}
+	Misses.fetch_add(1, std::memory_order_relaxed);
+	return false;
+}
+
+void FAffinityTableQueryCache::Add(const uint64 Key, const uint32 Epoch, FEntry&& Entry)
+{
+	FWriteScopeLock WriteLock(Lock);
+	if (Epoch != CacheEpoch)
+	{
+		// This result was resolved before the table changed. The signed distance survives epoch wrap-around.
+		if (static_cast<int32>(Epoch - CacheEpoch) < 0)
+		{
+			return;
+		}
+
+		// Entries from an older epoch may point to memory that no longer exists
+		Entries.Reset();
+		CacheEpoch = Epoch;
+	}
+	Entries.Add(Key, MoveTemp(Entry));
+}
+
+void FAffinityTableQueryCache::Reset()
+{
+	FWriteScopeLock WriteLock(Lock);
+	Entries.Empty();
+	Hits.store(0, std::memory_order_relaxed);
+	Misses.store(0, std::memory_order_relaxed);
+}
+
+int32 FAffinityTableQueryCache::Num() const
+{
+	FReadScopeLock ReadLock(Lock);
+	return Entries.Num();
+}
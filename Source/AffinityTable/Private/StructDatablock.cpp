@@ -16,24 +16,38 @@
 
 #include "StructDatablock.h"
 #include "AffinityTable.h"
+#include "HAL/IConsoleManager.h"
 
-FStructDatablock::FStructDatablock(const UScriptStruct* InStruct, const uint32 DesiredCapacity, bool AllocNow /* = false */)
+static int32 GAffinityTableDatablockTargetKB = 64;
+static FAutoConsoleVariableRef CVarAffinityTableDatablockTargetKB(
+	TEXT("AffinityTable.DatablockTargetKB"),
+	GAffinityTableDatablockTargetKB,
+	TEXT("Target size of the datablocks of dynamic affinity table pages, in KB. Applies to pages created afterwards."));
+
+static int32 GAffinityTableDatablockOSAllocKB = 2048;
+static FAutoConsoleVariableRef CVarAffinityTableDatablockOSAllocKB(
+	TEXT("AffinityTable.DatablockOSAllocKB"),
+	GAffinityTableDatablockOSAllocKB,
+	TEXT("Affinity table datablocks of at least this size, in KB, are allocated straight from the OS instead of the allocator. Zero disables it."));
+
+FStructDatablock::FStructDatablock(const UScriptStruct* InStruct, const uint32 DesiredCapacity, bool AllocNow /* = false */, bool InitializeNow /* = true */, uint32 InCellAlignment /* = 0 */)
 	: Struct(InStruct)
 	, Datablock(nullptr)
 	, Capacity(1)
 	, StructSize(0)
+	, CellAlignment(InCellAlignment)
+	, CellStride(0)
+	, bAllocatedFromOS(false)
 	, NextHandle(InvalidHandle)
 {
+	check(FMath::IsPowerOfTwo(InCellAlignment) || InCellAlignment == 0);
 	check(DesiredCapacity);
 	StructName = Struct->GetFName();
-
-	// Warn if we need to cap this capacity
-	Capacity = DesiredCapacity < MaxDatablockCapacity ? DesiredCapacity : MaxDatablockCapacity;
-	check(Capacity == DesiredCapacity);
+	Capacity = DesiredCapacity;
 
 	if (AllocNow)
 	{
-		Alloc();
+		Alloc(InitializeNow);
 	}
 }
 
@@ -59,10 +73,15 @@ FStructDatablock::DatablockHandle FStructDatablock::NewHandle()
 	// Refurbished handle.
 	if (FreeHandles.Num() > 0)
 	{
-		DatablockHandle RecycledHandle;
-		FreeHandles.HeapPop(RecycledHandle);
-
-		Struct->ClearScriptStruct(GetMemoryBlock(RecycledHandle));
+		const DatablockHandle RecycledHandle = FreeHandles.Pop();
+		if (Traits.bZeroConstructor && Traits.bNoDestructor)
+		{
+			FMemory::Memzero(GetMemoryBlock(RecycledHandle), StructSize);
+		}
+		else
+		{
+			Struct->ClearScriptStruct(GetMemoryBlock(RecycledHandle));
+		}
 		return RecycledHandle;
 	}
 
@@ -72,7 +91,8 @@ FStructDatablock::DatablockHandle FStructDatablock::NewHandle()
 
 void FStructDatablock::RecycleHandle(FStructDatablock::DatablockHandle Handle)
 {
-	check(Handle != InvalidHandle);
+	check(Handle != InvalidHandle && Handle < NextHandle);
+	checkSlow(!FreeHandles.Contains(Handle));
 	FreeHandles.Add(Handle);
 }
 
@@ -84,7 +104,7 @@ void FStructDatablock::GarbageCollect()
 	}
 }
 
-void FStructDatablock::Alloc()
+void FStructDatablock::Alloc(bool Initialize /* = true */)
 {
 	check(Datablock == nullptr);
 	check(FreeHandles.Num() == 0);
@@ -92,10 +112,123 @@ void FStructDatablock::Alloc()
 	StructSize = static_cast<SIZE_T>(Struct->GetStructureSize());
 	check(StructSize);
 
-	Datablock = (DatablockPtrType) FMemory::Malloc(StructSize * static_cast<SIZE_T>(Capacity));
+	// The default allocator alignment is not enough for structures with SIMD or over-aligned members
+	Traits = GetStructTraits(Struct.Get());
+	CellStride = ComputeCellStride(Struct.Get(), CellAlignment);
+	const SIZE_T Size = CellStride * static_cast<SIZE_T>(Capacity);
+	const uint32 Alignment = ComputeAlignment(Struct.Get(), CellAlignment);
+
+	// Large blocks skip the allocator. OS allocations are page aligned, but not huge page aligned, so we give the OS
+	// no huge page hint: whether huge pages back them is up to its defaults.
+	bAllocatedFromOS = GAffinityTableDatablockOSAllocKB > 0 && Size >= static_cast<SIZE_T>(GAffinityTableDatablockOSAllocKB) * 1024 &&
+					   Alignment <= FPlatformMemory::GetConstants().PageSize;
+	if (bAllocatedFromOS)
+	{
+		// Fresh OS pages are zero filled (mmap and VirtualAlloc both guarantee it), and InitializeOrDestroyCells relies
+		// on it to skip clearing zero-constructed structures. Anything that recycles OS memory must clear it first.
+		Datablock = (DatablockPtrType) FPlatformMemory::BinnedAllocFromOS(Size);
+	}
+	else
+	{
+		Datablock = (DatablockPtrType) FMemory::Malloc(Size, Alignment);
+	}
 	check(Datablock != nullptr);
 
-	Struct->InitializeStruct(Datablock, static_cast<int32>(Capacity));
+	if (Initialize)
+	{
+		InitializeOrDestroyCells(true);
+	}
+	NextHandle = 0;
+}
+
+void FStructDatablock::InitializeOrDestroyCells(const bool Initialize)
+{
+	// Plain structures skip reflection entirely. OS allocations come zeroed, so they need no work at all.
+	if (Initialize && Traits.bZeroConstructor)
+	{
+		if (!bAllocatedFromOS)
+		{
+			FMemory::Memzero(Datablock, CellStride * static_cast<SIZE_T>(Capacity));
+		}
+		return;
+	}
+	if (!Initialize && Traits.bNoDestructor)
+	{
+		return;
+	}
+
+	// Packed cells are a plain array of structures
+	if (CellStride == StructSize)
+	{
+		if (Initialize)
+		{
+			Struct->InitializeStruct(Datablock, static_cast<int32>(Capacity));
+		}
+		else
+		{
+			Struct->DestroyStruct(Datablock, static_cast<int32>(Capacity));
+		}
+		return;
+	}
+
+	for (uint32 i = 0; i < Capacity; ++i)
+	{
+		if (Initialize)
+		{
+			Struct->InitializeStruct(GetMemoryBlock(i));
+		}
+		else
+		{
+			Struct->DestroyStruct(GetMemoryBlock(i));
+		}
+	}
+}
+
+FStructDatablock::StructTraits FStructDatablock::GetStructTraits(const UScriptStruct* InStruct)
+{
+	check(InStruct);
+
+	StructTraits Result;
+	if (InStruct->StructFlags & STRUCT_Native)
+	{
+		Result.bZeroConstructor = (InStruct->StructFlags & STRUCT_ZeroConstructor) != 0;
+		Result.bPlainOldData = (InStruct->StructFlags & STRUCT_IsPlainOldData) != 0;
+		Result.bNoDestructor = (InStruct->StructFlags & (STRUCT_IsPlainOldData | STRUCT_NoDestructor)) != 0;
+	}
+	return Result;
+}
+
+uint32 FStructDatablock::ComputeCapacity(const UScriptStruct* InStruct, const uint32 InCellAlignment)
+{
+	const SIZE_T TargetSize = static_cast<SIZE_T>(FMath::Max(GAffinityTableDatablockTargetKB, 1)) * 1024;
+	return static_cast<uint32>(FMath::Clamp<SIZE_T>(TargetSize / ComputeCellStride(InStruct, InCellAlignment), 1, MAX_uint32 - 1));
+}
+
+uint32 FStructDatablock::ComputeAlignment(const UScriptStruct* InStruct, const uint32 InCellAlignment)
+{
+	check(InStruct);
+	return FMath::Max(static_cast<uint32>(FMath::Max(InStruct->GetMinAlignment(), 1)), InCellAlignment);
+}
+
+SIZE_T FStructDatablock::ComputeCellStride(const UScriptStruct* InStruct, const uint32 InCellAlignment)
+{
+	check(InStruct);
+	return Align(static_cast<SIZE_T>(InStruct->GetStructureSize()), static_cast<SIZE_T>(ComputeAlignment(InStruct, InCellAlignment)));
+}
+
+void FStructDatablock::Adopt(DatablockPtrType InMemory)
+{
+	check(Datablock == nullptr && InMemory != nullptr);
+	check(FreeHandles.Num() == 0);
+
+	StructSize = static_cast<SIZE_T>(Struct->GetStructureSize());
+	check(StructSize);
+
+	Traits = GetStructTraits(Struct.Get());
+	CellStride = ComputeCellStride(Struct.Get(), CellAlignment);
+	check(CellStride == StructSize && IsAligned(InMemory, ComputeAlignment(Struct.Get(), CellAlignment)));
+
+	Datablock = InMemory;
 	NextHandle = 0;
 }
 
@@ -113,7 +246,7 @@ void FStructDatablock::Dealloc()
 		// process will survive. We still safely de-allocate the memory created by this block.
 		if (Struct.IsValid() && Struct->IsValidLowLevel() && !Struct->GetFName().IsNone())
 		{
-			Struct->DestroyStruct(Datablock, Capacity);
+			InitializeOrDestroyCells(false);
 		}
 		else
 		{
@@ -132,7 +265,15 @@ void FStructDatablock::Dealloc()
 			}
 		}
 
-		FMemory::Free(Datablock);
+		if (bAllocatedFromOS)
+		{
+			FPlatformMemory::BinnedFreeToOS(Datablock, CellStride * static_cast<SIZE_T>(Capacity));
+		}
+		else
+		{
+			FMemory::Free(Datablock);
+		}
+		bAllocatedFromOS = false;
 
 		Datablock = nullptr;
 		NextHandle = InvalidHandle;
@@ -0,0 +1,78 @@
+/**
+ * Copyright 2024 Inflexion Games. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AffinityTableTestTypes.generated.h"
+
+/**
+ * Cell with data that only serializes property by property. Used by the automation tests
+ */
+USTRUCT()
+struct FAffinityTableTestCell
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY()
+	int32 Count{ 0 };
+
+	UPROPERTY()
+	float Weight{ 1.0f };
+
+	UPROPERTY()
+	FString Label;
+};
+
+/**
+ * Plain data cell, which pages can store as raw images. Used by the automation tests
+ */
+USTRUCT()
+struct FAffinityTableTestPlainCell
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY()
+	int32 Count{ 0 };
+
+	UPROPERTY()
+	float Weight{ 1.0f };
+
+	UPROPERTY()
+	bool bEnabled{ false };
+};
+
+/**
+ * Current layout of a cell saved with an older schema: Count was OldCount, Weight was a float, Tier was a string and
+ * a property was removed. Used by the migration test
+ */
+USTRUCT()
+struct FAffinityTableTestMigratedCell
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY()
+	int32 Count{ 0 };
+
+	UPROPERTY()
+	int32 Weight{ 0 };
+
+	UPROPERTY()
+	int32 Tier{ 3 };
+
+	UPROPERTY()
+	int32 Kept{ 0 };
+};
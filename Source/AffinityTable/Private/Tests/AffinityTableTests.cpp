@@ -0,0 +1,552 @@
+/**
+ * Copyright 2024 Inflexion Games. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AffinityTable.h"
+#include "AffinityTablePage.h"
+#include "AffinityTableTestTypes.h"
+
+#include "GameplayTagRedirectors.h"
+#include "GameplayTagsSettings.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/ScopeExit.h"
+#include "NativeGameplayTags.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/ObjectAndNameAsStringProxyArchive.h"
+#include "Serialization/ObjectReader.h"
+#include "Serialization/ObjectWriter.h"
+#include "UObject/CoreRedirects.h"
+#include "UObject/StrongObjectPtr.h"
+
+#if WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
+
+/**
+ * Reaches the encoders and loaders of UAffinityTable, which tests drive one page at a time
+ */
+struct FAffinityTableTestAccess
+{
+	using CellSchema = UAffinityTable::CellSchema;
+	using SchemaProperty = UAffinityTable::SchemaProperty;
+	using MigrationStep = UAffinityTable::MigrationStep;
+
+	static void AllocatePageMemory(UAffinityTable& Table)
+	{
+		Table.AllocatePageMemory(Table.GetRows().Num(), Table.GetColumns().Num());
+	}
+
+	static FAffinityTablePage* GetPage(const UAffinityTable& Table, const UScriptStruct* Struct)
+	{
+		return Table.GetPageForStruct(Struct);
+	}
+
+	static void SerializePage(UAffinityTable& Table, FArchive& Ar, UScriptStruct* Struct)
+	{
+		Table.SerializePage(Ar, Table.GetPageForStruct(Struct), Struct);
+	}
+
+	static void SaveCells(UAffinityTable& Table, FArchive& Ar, UScriptStruct* Struct)
+	{
+		Table.SaveCells(Ar, Table.GetPageForStruct(Struct), Struct);
+	}
+
+	static void LoadCells(UAffinityTable& Table, FArchive& Ar, UScriptStruct* Struct)
+	{
+		Table.LoadCells(Ar, Table.GetPageForStruct(Struct), Struct);
+	}
+
+	static void BuildCellSchema(const UScriptStruct* Struct, FArchive& Ar, CellSchema& OutSchema, TArray<MigrationStep>& OutPlan)
+	{
+		UAffinityTable::BuildCellSchema(Struct, Ar, OutSchema, OutPlan);
+	}
+
+	static bool BuildMigrationPlan(const UAffinityTable& Table, const UScriptStruct* Struct, FArchive& Ar, const CellSchema& Schema, TArray<MigrationStep>& OutPlan)
+	{
+		return Table.BuildMigrationPlan(Struct, Ar, Schema, OutPlan);
+	}
+
+	static void SerializeCell(FArchive& Ar, TConstArrayView<MigrationStep> Plan, void* Data)
+	{
+		UAffinityTable::SerializeCell(Ar, Plan, Data);
+	}
+
+	static void RedirectTags(UAffinityTable& Table)
+	{
+		// Tags are resolved from the ordered tags a load reads, which saves write. See PreSaveTable.
+		Table.PreSaveTable();
+		Table.RedirectTags();
+		Table.RebuildResolutionIndexes();
+	}
+};
+
+namespace AffinityTableTests
+{
+UE_DEFINE_GAMEPLAY_TAG_STATIC(TAG_Row_A, "AffinityTableTest.Row.A");
+UE_DEFINE_GAMEPLAY_TAG_STATIC(TAG_Row_B, "AffinityTableTest.Row.B");
+UE_DEFINE_GAMEPLAY_TAG_STATIC(TAG_Row_Old, "AffinityTableTest.Row.Old");
+UE_DEFINE_GAMEPLAY_TAG_STATIC(TAG_Row_New, "AffinityTableTest.Row.New");
+UE_DEFINE_GAMEPLAY_TAG_STATIC(TAG_Column_A, "AffinityTableTest.Column.A");
+UE_DEFINE_GAMEPLAY_TAG_STATIC(TAG_Column_B, "AffinityTableTest.Column.B");
+
+/** Values of a test cell, derived from its tags so they survive loads that reorder rows and columns */
+static FAffinityTableTestCell MakeCell(const FGameplayTag& Row, const FGameplayTag& Column)
+{
+	FAffinityTableTestCell Cell;
+	Cell.Label = Row.ToString() + TEXT("|") + Column.ToString();
+	Cell.Count = static_cast<int32>(GetTypeHash(Cell.Label) & 0xffff);
+	Cell.Weight = Cell.Count * 0.5f;
+	return Cell;
+}
+
+/** Values of a plain test cell, see MakeCell */
+static FAffinityTableTestPlainCell MakePlainCell(const FGameplayTag& Row, const FGameplayTag& Column)
+{
+	const int32 Seed = MakeCell(Row, Column).Count;
+	FAffinityTableTestPlainCell Cell;
+	Cell.Count = -Seed;
+	Cell.Weight = Seed * 0.25f;
+	Cell.bEnabled = Seed % 2 == 0;
+	return Cell;
+}
+
+/**
+ * Creates a transient table with pages for both test cells and the provided rows and columns. Every cell holds the
+ * values of MakeCell and MakePlainCell.
+ */
+static UAffinityTable* NewTable(std::initializer_list<FGameplayTag> InRows, std::initializer_list<FGameplayTag> InColumns)
+{
+	UAffinityTable* Table = NewObject<UAffinityTable>(GetTransientPackage(), NAME_None, RF_Transient);
+	Table->Structures = { FAffinityTableTestCell::StaticStruct(), FAffinityTableTestPlainCell::StaticStruct() };
+	FAffinityTableTestAccess::AllocatePageMemory(*Table);
+	for (const FGameplayTag& Row : InRows)
+	{
+		Table->AddRow(Row);
+	}
+	for (const FGameplayTag& Column : InColumns)
+	{
+		Table->AddColumn(Column);
+	}
+
+	for (const TPair<FGameplayTag, UAffinityTable::TagIndex>& Row : Table->GetRows())
+	{
+		for (const TPair<FGameplayTag, UAffinityTable::TagIndex>& Column : Table->GetColumns())
+		{
+			const UAffinityTable::Cell Cell{ Row.Value, Column.Value };
+			*reinterpret_cast<FAffinityTableTestCell*>(Table->GetMutableCellData(Cell, FAffinityTableTestCell::StaticStruct())) = MakeCell(Row.Key, Column.Key);
+			*reinterpret_cast<FAffinityTableTestPlainCell*>(Table->GetMutableCellData(Cell, FAffinityTableTestPlainCell::StaticStruct())) = MakePlainCell(Row.Key, Column.Key);
+		}
+	}
+	return Table;
+}
+
+/** Resets every cell of a page to its defaults, so a load into the page has to restore them */
+template <typename T>
+static void ResetCells(UAffinityTable& Table)
+{
+	for (const TPair<FGameplayTag, UAffinityTable::TagIndex>& Row : Table.GetRows())
+	{
+		for (const TPair<FGameplayTag, UAffinityTable::TagIndex>& Column : Table.GetColumns())
+		{
+			*reinterpret_cast<T*>(Table.GetMutableCellData(UAffinityTable::Cell{ Row.Value, Column.Value }, T::StaticStruct())) = T();
+		}
+	}
+}
+
+static void TestCell(FAutomationTestBase& Test, const FString& What, const FAffinityTableTestCell* Data, const FAffinityTableTestCell& Expected)
+{
+	if (Test.TestNotNull(*What, Data))
+	{
+		Test.TestEqual(*(What + TEXT(" Count")), Data->Count, Expected.Count);
+		Test.TestEqual(*(What + TEXT(" Weight")), Data->Weight, Expected.Weight);
+		Test.TestEqual(*(What + TEXT(" Label")), Data->Label, Expected.Label);
+	}
+}
+
+static void TestCell(FAutomationTestBase& Test, const FString& What, const FAffinityTableTestPlainCell* Data, const FAffinityTableTestPlainCell& Expected)
+{
+	if (Test.TestNotNull(*What, Data))
+	{
+		Test.TestEqual(*(What + TEXT(" Count")), Data->Count, Expected.Count);
+		Test.TestEqual(*(What + TEXT(" Weight")), Data->Weight, Expected.Weight);
+		Test.TestEqual(*(What + TEXT(" bEnabled")), Data->bEnabled, Expected.bEnabled);
+	}
+}
+
+/** Checks that every cell of a table holds the values of MakeCell and MakePlainCell, except those of SkippedRow */
+static void TestCells(FAutomationTestBase& Test, const UAffinityTable& Table, const TCHAR* What, const FGameplayTag& SkippedRow = FGameplayTag::EmptyTag)
+{
+	const bool HasCells = Table.GetPageIndex(FAffinityTableTestCell::StaticStruct()) != UAffinityTable::InvalidPageIndex;
+	const bool HasPlainCells = Table.GetPageIndex(FAffinityTableTestPlainCell::StaticStruct()) != UAffinityTable::InvalidPageIndex;
+	for (const TPair<FGameplayTag, UAffinityTable::TagIndex>& Row : Table.GetRows())
+	{
+		if (Row.Key == SkippedRow)
+		{
+			continue;
+		}
+
+		for (const TPair<FGameplayTag, UAffinityTable::TagIndex>& Column : Table.GetColumns())
+		{
+			const UAffinityTable::Cell Cell{ Row.Value, Column.Value };
+			const FString Where = FString::Printf(TEXT("%s, cell %s|%s"), What, *Row.Key.ToString(), *Column.Key.ToString());
+			if (HasCells)
+			{
+				TestCell(Test, Where, reinterpret_cast<const FAffinityTableTestCell*>(Table.GetCellData(Cell, FAffinityTableTestCell::StaticStruct())),
+					MakeCell(Row.Key, Column.Key));
+			}
+			if (HasPlainCells)
+			{
+				TestCell(Test, Where, reinterpret_cast<const FAffinityTableTestPlainCell*>(Table.GetCellData(Cell, FAffinityTableTestPlainCell::StaticStruct())),
+					MakePlainCell(Row.Key, Column.Key));
+			}
+		}
+	}
+}
+
+/** Saves a table the way the editor does, into a new table */
+static UAffinityTable* RoundTrip(UAffinityTable& Table)
+{
+	TArray<uint8> Bytes;
+	FObjectWriter Writer(&Table, Bytes);
+
+	UAffinityTable* Loaded = NewObject<UAffinityTable>(GetTransientPackage(), NAME_None, RF_Transient);
+	FObjectReader Reader(Loaded, Bytes);
+	return Loaded;
+}
+
+/** Adds a gameplay tag redirect for the lifetime of the instance */
+struct FScopedTagRedirect
+{
+	FScopedTagRedirect(const FGameplayTag& OldTag, const FGameplayTag& NewTag)
+	{
+		FGameplayTagRedirect& Redirect = GetMutableDefault<UGameplayTagsSettings>()->GameplayTagRedirects.AddDefaulted_GetRef();
+		Redirect.OldTagName = OldTagName = OldTag.GetTagName();
+		Redirect.NewTagName = NewTag.GetTagName();
+		FGameplayTagRedirectors::Get().RefreshTagRedirects();
+	}
+
+	~FScopedTagRedirect()
+	{
+		GetMutableDefault<UGameplayTagsSettings>()->GameplayTagRedirects.RemoveAll(
+			[this](const FGameplayTagRedirect& Redirect) { return Redirect.OldTagName == OldTagName; });
+		FGameplayTagRedirectors::Get().RefreshTagRedirects();
+	}
+
+	FName OldTagName;
+};
+} // namespace AffinityTableTests
+
+using namespace AffinityTableTests;
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableCellBlobTest, "AffinityTable.Serialization.CellBlob", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableCellBlobTest::RunTest(const FString& Parameters)
+{
+	// Editor saves write every page as a cell blob
+	TStrongObjectPtr<UAffinityTable> Table(NewTable({ TAG_Row_A, TAG_Row_B }, { TAG_Column_A, TAG_Column_B }));
+	TStrongObjectPtr<UAffinityTable> Loaded(RoundTrip(*Table));
+	TestFalse(TEXT("Loading errors"), Loaded->HasLoadingErrors());
+	TestEqual(TEXT("Rows"), Loaded->GetRows().Num(), Table->GetRows().Num());
+	TestEqual(TEXT("Columns"), Loaded->GetColumns().Num(), Table->GetColumns().Num());
+	TestCells(*this, *Loaded, TEXT("First load"));
+
+	// The next save copies the records of clean cells, and serializes the ones that changed
+	const UAffinityTable::Cell Changed{ Loaded->GetRowIndex(TAG_Row_A), Loaded->GetColumnIndex(TAG_Column_A) };
+	FAffinityTableTestCell* ChangedData = reinterpret_cast<FAffinityTableTestCell*>(Loaded->GetMutableCellData(Changed, FAffinityTableTestCell::StaticStruct()));
+	if (!TestNotNull(TEXT("Changed cell"), ChangedData))
+	{
+		return false;
+	}
+	ChangedData->Label = TEXT("Changed");
+	FAffinityTableTestCell Expected = MakeCell(TAG_Row_A, TAG_Column_A);
+	Expected.Label = TEXT("Changed");
+
+	TStrongObjectPtr<UAffinityTable> Reloaded(RoundTrip(*Loaded));
+	TestCells(*this, *Reloaded, TEXT("Second load"), TAG_Row_A);
+	TestCell(*this, TEXT("Changed cell"),
+		reinterpret_cast<const FAffinityTableTestCell*>(Reloaded->GetCellData(UAffinityTable::Cell{ Reloaded->GetRowIndex(TAG_Row_A), Reloaded->GetColumnIndex(TAG_Column_A) }, FAffinityTableTestCell::StaticStruct())),
+		Expected);
+	TestCell(*this, TEXT("Unchanged cell"),
+		reinterpret_cast<const FAffinityTableTestCell*>(Reloaded->GetCellData(UAffinityTable::Cell{ Reloaded->GetRowIndex(TAG_Row_A), Reloaded->GetColumnIndex(TAG_Column_B) }, FAffinityTableTestCell::StaticStruct())),
+		MakeCell(TAG_Row_A, TAG_Column_B));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableCellsEncodingTest, "AffinityTable.Serialization.Cells", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableCellsEncodingTest::RunTest(const FString& Parameters)
+{
+	// Cooked pages without a raw image: schema, then cells in schema order
+	TStrongObjectPtr<UAffinityTable> Table(NewTable({ TAG_Row_A, TAG_Row_B }, { TAG_Column_A, TAG_Column_B }));
+	UScriptStruct* Struct = FAffinityTableTestCell::StaticStruct();
+
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes, true);
+	FObjectAndNameAsStringProxyArchive WriterProxy(Writer, false);
+	FAffinityTableTestAccess::SaveCells(*Table, WriterProxy, Struct);
+
+	ResetCells<FAffinityTableTestCell>(*Table);
+	FMemoryReader Reader(Bytes, true);
+	FObjectAndNameAsStringProxyArchive ReaderProxy(Reader, false);
+	FAffinityTableTestAccess::LoadCells(*Table, ReaderProxy, Struct);
+	TestEqual(TEXT("Bytes read"), Reader.Tell(), Reader.TotalSize());
+	TestCells(*this, *Table, TEXT("Cells"));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableTaggedEncodingTest, "AffinityTable.Serialization.Tagged", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableTaggedEncodingTest::RunTest(const FString& Parameters)
+{
+	// Older formats: tagged properties, cell by cell
+	TStrongObjectPtr<UAffinityTable> Table(NewTable({ TAG_Row_A, TAG_Row_B }, { TAG_Column_A, TAG_Column_B }));
+	UScriptStruct* Struct = FAffinityTableTestCell::StaticStruct();
+
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes, true);
+	FObjectAndNameAsStringProxyArchive WriterProxy(Writer, false);
+	FAffinityTableTestAccess::SerializePage(*Table, WriterProxy, Struct);
+
+	ResetCells<FAffinityTableTestCell>(*Table);
+	FMemoryReader Reader(Bytes, true);
+	FObjectAndNameAsStringProxyArchive ReaderProxy(Reader, false);
+	FAffinityTableTestAccess::SerializePage(*Table, ReaderProxy, Struct);
+	TestEqual(TEXT("Bytes read"), Reader.Tell(), Reader.TotalSize());
+	TestCells(*this, *Table, TEXT("Tagged"));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableRawImageEncodingTest, "AffinityTable.Serialization.RawImage", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableRawImageEncodingTest::RunTest(const FString& Parameters)
+{
+	// Cooked plain-data pages: a raw image of the cells, loaded into a dense page
+	TStrongObjectPtr<UAffinityTable> Table(NewTable({ TAG_Row_A, TAG_Row_B }, { TAG_Column_A, TAG_Column_B }));
+	UScriptStruct* Struct = FAffinityTableTestPlainCell::StaticStruct();
+	TestTrue(TEXT("Plain cells support raw images"), FAffinityTablePage::SupportsRawImage(Struct));
+	TestFalse(TEXT("Cells with strings support raw images"), FAffinityTablePage::SupportsRawImage(FAffinityTableTestCell::StaticStruct()));
+
+	TArray<uint32> RowOrder, ColumnOrder;
+	Table->GetRows().GenerateValueArray(RowOrder);
+	Table->GetColumns().GenerateValueArray(ColumnOrder);
+
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes, true);
+	const int64 ImageSize = FAffinityTableTestAccess::GetPage(*Table, Struct)->SaveRawImage(Writer, RowOrder, ColumnOrder);
+	TestEqual(TEXT("Image size"), ImageSize, static_cast<int64>(RowOrder.Num()) * ColumnOrder.Num() * Struct->GetStructureSize());
+
+	FAffinityTablePage Dense(Struct, RowOrder.Num(), ColumnOrder.Num(), true, false);
+	FMemoryReader Reader(Bytes, true);
+	TestFalse(TEXT("Image of other dimensions loads"), Dense.LoadRawImage(Reader, ImageSize + 1));
+	TestEqual(TEXT("Bytes read by a rejected image"), Reader.Tell(), static_cast<int64>(0));
+	if (!TestTrue(TEXT("Image loads"), Dense.LoadRawImage(Reader, ImageSize)))
+	{
+		return false;
+	}
+
+	// The image holds rows and columns in map order
+	TArray<FGameplayTag> RowOrderTags, ColumnOrderTags;
+	Table->GetRows().GenerateKeyArray(RowOrderTags);
+	Table->GetColumns().GenerateKeyArray(ColumnOrderTags);
+	for (int32 Row = 0; Row < RowOrder.Num(); ++Row)
+	{
+		for (int32 Column = 0; Column < ColumnOrder.Num(); ++Column)
+		{
+			const FString Where = FString::Printf(TEXT("Raw image, cell %s|%s"), *RowOrderTags[Row].ToString(), *ColumnOrderTags[Column].ToString());
+			TestCell(*this, Where, reinterpret_cast<const FAffinityTableTestPlainCell*>(Dense.GetDatablockPtr(Row, Column)),
+				MakePlainCell(RowOrderTags[Row], ColumnOrderTags[Column]));
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableSchemaMigrationTest, "AffinityTable.Serialization.SchemaMigration", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableSchemaMigrationTest::RunTest(const FString& Parameters)
+{
+	using FAccess = FAffinityTableTestAccess;
+	const UScriptStruct* Struct = FAffinityTableTestMigratedCell::StaticStruct();
+	TStrongObjectPtr<UAffinityTable> Table(NewObject<UAffinityTable>(GetTransientPackage(), NAME_None, RF_Transient));
+
+	// An identical schema reads every property as it was written
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes, true);
+	FAccess::CellSchema Current;
+	TArray<FAccess::MigrationStep> Plan;
+	FAccess::BuildCellSchema(Struct, Writer, Current, Plan);
+	TestTrue(TEXT("Current schema needs no migration"), FAccess::BuildMigrationPlan(*Table, Struct, Writer, Current, Plan));
+
+	// A cell written before Count was renamed from OldCount, Weight and Tier changed type, and Removed was removed
+	FAccess::CellSchema Saved;
+	Saved.Properties = {
+		{ TEXT("OldCount"), TEXT("int32"), 1 },
+		{ TEXT("Weight"), TEXT("float"), 1 },
+		{ TEXT("Tier"), TEXT("FString"), 1 },
+		{ TEXT("Removed"), TEXT("int32"), 1 },
+		{ TEXT("Kept"), TEXT("int32"), 1 }
+	};
+
+	// Values are prefixed by their size, see UAffinityTable::SerializeCell
+	auto WriteValue = [&Writer](auto Value) {
+		int32 Size = 0;
+		const int64 SizePos = Writer.Tell();
+		Writer << Size;
+		const int64 Begin = Writer.Tell();
+		Writer << Value;
+		const int64 End = Writer.Tell();
+		Size = static_cast<int32>(End - Begin);
+		Writer.Seek(SizePos);
+		Writer << Size;
+		Writer.Seek(End);
+	};
+	WriteValue(static_cast<int32>(7));
+	WriteValue(2.75f);
+	WriteValue(FString(TEXT("Gold")));
+	WriteValue(static_cast<int32>(99));
+	WriteValue(static_cast<int32>(11));
+
+	const TArray<FCoreRedirect> Redirects = { FCoreRedirect(ECoreRedirectFlags::Type_Property, TEXT("AffinityTableTestMigratedCell.OldCount"), TEXT("Count")) };
+	FCoreRedirects::AddRedirectList(Redirects, TEXT("AffinityTableTests"));
+	ON_SCOPE_EXIT
+	{
+		FCoreRedirects::RemoveRedirectList(Redirects, TEXT("AffinityTableTests"));
+	};
+
+	AddExpectedError(TEXT("changed from FString to int32 and cannot be converted"), EAutomationExpectedErrorFlags::Contains, 1);
+	FMemoryReader Reader(Bytes, true);
+	TestFalse(TEXT("Older schema needs a migration"), FAccess::BuildMigrationPlan(*Table, Struct, Reader, Saved, Plan));
+	if (!TestEqual(TEXT("Migration steps"), Plan.Num(), Saved.Properties.Num()))
+	{
+		return false;
+	}
+	TestNull(TEXT("Removed property"), Plan[3].Property);
+
+	FAffinityTableTestMigratedCell Cell;
+	FAccess::SerializeCell(Reader, Plan, &Cell);
+	TestEqual(TEXT("Bytes read"), Reader.Tell(), Reader.TotalSize());
+	TestEqual(TEXT("Renamed property"), Cell.Count, 7);
+	TestEqual(TEXT("Property converted from float"), Cell.Weight, 2);
+	TestEqual(TEXT("Property that cannot be converted"), Cell.Tier, FAffinityTableTestMigratedCell().Tier);
+	TestEqual(TEXT("Property after a removed one"), Cell.Kept, 11);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableTagRedirectTest, "AffinityTable.Tags.Redirect", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableTagRedirectTest::RunTest(const FString& Parameters)
+{
+	TStrongObjectPtr<UAffinityTable> Table(NewTable({ TAG_Row_Old }, { TAG_Column_A }));
+	const UAffinityTable::TagIndex OldIndex = Table->GetRowIndex(TAG_Row_Old);
+	const UAffinityTable::TagIndex Column = Table->GetColumnIndex(TAG_Column_A);
+
+	// Renamed rows keep their index, so their cells do not move
+	FScopedTagRedirect Redirect(TAG_Row_Old, TAG_Row_New);
+	FAffinityTableTestAccess::RedirectTags(*Table);
+	TestFalse(TEXT("Old row"), Table->GetRows().Contains(TAG_Row_Old));
+	TestTrue(TEXT("Ordered rows hold the new tag"), Table->RowTags.Contains(TAG_Row_New) && !Table->RowTags.Contains(TAG_Row_Old));
+	TestEqual(TEXT("Renamed row index"), Table->GetRowIndex(TAG_Row_New), OldIndex);
+	TestCell(*this, TEXT("Renamed row"),
+		reinterpret_cast<const FAffinityTableTestCell*>(Table->GetCellData(UAffinityTable::Cell{ OldIndex, Column }, FAffinityTableTestCell::StaticStruct())),
+		MakeCell(TAG_Row_Old, TAG_Column_A));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableTagRedirectCollisionTest, "AffinityTable.Tags.RedirectCollision", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableTagRedirectCollisionTest::RunTest(const FString& Parameters)
+{
+	TStrongObjectPtr<UAffinityTable> Table(NewTable({ TAG_Row_Old, TAG_Row_New }, { TAG_Column_A }));
+	const UAffinityTable::TagIndex OldIndex = Table->GetRowIndex(TAG_Row_Old);
+	const UAffinityTable::TagIndex NewIndex = Table->GetRowIndex(TAG_Row_New);
+
+	// A redirect onto a row we already have is left for a human to merge
+	AddExpectedError(TEXT("which the table already has"), EAutomationExpectedErrorFlags::Contains, 1);
+	FScopedTagRedirect Redirect(TAG_Row_Old, TAG_Row_New);
+	FAffinityTableTestAccess::RedirectTags(*Table);
+	TestEqual(TEXT("Redirected row index"), Table->GetRowIndex(TAG_Row_Old), OldIndex);
+	TestEqual(TEXT("Existing row index"), Table->GetRowIndex(TAG_Row_New), NewIndex);
+	TestCells(*this, *Table, TEXT("Collision"));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableCompactionTest, "AffinityTable.Pages.Compaction", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableCompactionTest::RunTest(const FString& Parameters)
+{
+	// Deleted rows and columns leave holes in the datablocks of dynamic pages
+	TStrongObjectPtr<UAffinityTable> Table(NewTable({ TAG_Row_A, TAG_Row_B }, { TAG_Column_A, TAG_Column_B }));
+	Table->DeleteRow(TAG_Row_A);
+	Table->DeleteColumn(TAG_Column_A);
+
+	int32 MovedCallbacks = 0;
+	Table->SetCellsMovedCallback([&MovedCallbacks]() { ++MovedCallbacks; });
+	const uint32 Epoch = Table->GetEpoch();
+	TestEqual(TEXT("Compacted pages"), Table->CompactPages(), 2);
+	TestEqual(TEXT("Cells moved callbacks"), MovedCallbacks, 1);
+	TestNotEqual(TEXT("Epoch"), Table->GetEpoch(), Epoch);
+	TestCells(*this, *Table, TEXT("Compacted"));
+
+	// Packed pages are left alone
+	TestEqual(TEXT("Pages compacted again"), Table->CompactPages(), 0);
+	TestEqual(TEXT("Cells moved callbacks after compacting again"), MovedCallbacks, 1);
+
+	// Cells added after compaction get room of their own
+	Table->AddRow(TAG_Row_A);
+	const FAffinityTableTestCell* Added = reinterpret_cast<const FAffinityTableTestCell*>(
+		Table->GetCellData(UAffinityTable::Cell{ Table->GetRowIndex(TAG_Row_A), Table->GetColumnIndex(TAG_Column_B) }, FAffinityTableTestCell::StaticStruct()));
+	TestCell(*this, TEXT("Cell added after compaction"), Added, FAffinityTableTestCell());
+	TestCells(*this, *Table, TEXT("Compacted, then grown"), TAG_Row_A);
+	Table->SetCellsMovedCallback(nullptr);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FAffinityTableHandleReuseTest, "AffinityTable.Pages.HandleReuse", EAutomationTestFlags::EditorContext | EAutomationTestFlags::ProductFilter)
+
+bool FAffinityTableHandleReuseTest::RunTest(const FString& Parameters)
+{
+	TStrongObjectPtr<UAffinityTable> Table(NewTable({ TAG_Row_A, TAG_Row_B }, { TAG_Column_A, TAG_Column_B }));
+	const UAffinityTable::TagIndex DeletedRow = Table->GetRowIndex(TAG_Row_A);
+	const UAffinityTable::TagIndex DeletedColumn = Table->GetColumnIndex(TAG_Column_A);
+	const UScriptStruct* Struct = FAffinityTableTestCell::StaticStruct();
+
+	// Deleted rows and columns no longer resolve, and their indexes no longer hold cells
+	Table->DeleteRow(TAG_Row_A);
+	Table->DeleteColumn(TAG_Column_A);
+	TestEqual(TEXT("Deleted row index"), Table->GetRowIndex(TAG_Row_A), UAffinityTable::InvalidIndex);
+	TestEqual(TEXT("Deleted column index"), Table->GetColumnIndex(TAG_Column_A), UAffinityTable::InvalidIndex);
+	TestNull(TEXT("Cell of a deleted row"), Table->GetCellData(UAffinityTable::Cell{ DeletedRow, Table->GetColumnIndex(TAG_Column_B) }, Struct));
+	TestNull(TEXT("Cell of a deleted column"), Table->GetCellData(UAffinityTable::Cell{ Table->GetRowIndex(TAG_Row_B), DeletedColumn }, Struct));
+
+	// Adding them back reuses the recycled handles, which must not carry the data of the deleted cells
+	Table->AddRow(TAG_Row_A);
+	Table->AddColumn(TAG_Column_A);
+	TestNotEqual(TEXT("Row index after adding it back"), Table->GetRowIndex(TAG_Row_A), DeletedRow);
+	TestNotEqual(TEXT("Column index after adding it back"), Table->GetColumnIndex(TAG_Column_A), DeletedColumn);
+	for (const TPair<FGameplayTag, UAffinityTable::TagIndex>& Row : Table->GetRows())
+	{
+		for (const TPair<FGameplayTag, UAffinityTable::TagIndex>& Column : Table->GetColumns())
+		{
+			const UAffinityTable::Cell Cell{ Row.Value, Column.Value };
+			const FString Where = FString::Printf(TEXT("Cell %s|%s"), *Row.Key.ToString(), *Column.Key.ToString());
+			const bool Added = Row.Key == TAG_Row_A || Column.Key == TAG_Column_A;
+			TestCell(*this, Where, reinterpret_cast<const FAffinityTableTestCell*>(Table->GetCellData(Cell, Struct)),
+				Added ? FAffinityTableTestCell() : MakeCell(Row.Key, Column.Key));
+			TestCell(*this, Where, reinterpret_cast<const FAffinityTableTestPlainCell*>(Table->GetCellData(Cell, FAffinityTableTestPlainCell::StaticStruct())),
+				Added ? FAffinityTableTestPlainCell() : MakePlainCell(Row.Key, Column.Key));
+		}
+	}
+	return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS && WITH_EDITOR
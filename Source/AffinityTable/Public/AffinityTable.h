@@ -20,11 +20,17 @@
 #include <functional>
 #endif
 
+#include "AffinityTableCellRange.h"
+#include "AffinityTablePageProjection.h"
+#include "AffinityTableQueryCache.h"
+#include "Async/Future.h"
 #include "CoreMinimal.h"
 #include "GameplayTagContainer.h"
 #include "Kismet/BlueprintFunctionLibrary.h"
 #include "Logging/LogMacros.h"
+#include "Serialization/BulkData.h"
 #include "UObject/Class.h"
+#include "UObject/ObjectSaveContext.h"
 #include "AffinityTable.generated.h"
 
 DECLARE_LOG_CATEGORY_EXTERN(LogAffinityTable, Log, All);
@@ -58,6 +64,36 @@ struct FAffinityTableCellDataWrapper
 	uint8* RawDataPtr;
 };
 
+/**
+ * Comparisons available to property searches. See UAffinityTable::FindCells
+ */
+enum class EAffinityTableComparison : uint8
+{
+	Less,
+	LessOrEqual,
+	Equal,
+	NotEqual,
+	GreaterOrEqual,
+	Greater
+};
+
+/**
+ * Selects numeric properties of a page to project into contiguous arrays. See FAffinityTablePageProjection.
+ */
+USTRUCT()
+struct FAffinityTableProjectionSettings
+{
+	GENERATED_USTRUCT_BODY()
+
+	/** Structure (page) to project */
+	UPROPERTY(EditAnywhere, Category = Projection)
+	UScriptStruct* Structure{ nullptr };
+
+	/** Numeric properties of the structure to project */
+	UPROPERTY(EditAnywhere, Category = Projection)
+	TArray<FName> Properties;
+};
+
 /**
  * Indexing
  *
@@ -72,6 +108,16 @@ struct FAffinityTableCellDataWrapper
  *	edit sessions, unused array locations on our TablePages are emptied (rows) or assigned invalid handles (columns), and their
  *	previous handles recycled for new locations. Serialization re-normalizes the data order.
  *
+ *	Closest-match (non exact) queries do not walk the tag hierarchy. On load we build a resolution index per axis, dense
+ *	by gameplay tag net index, that maps every tag known to the UGameplayTagsManager to the TagIndex it resolves to.
+ *	Non-exact lookups are then a net index query and a single array read. The index is rebuilt whenever the tag tree
+ *	changes, or rows/columns are added or removed in the editor. Rebuilds publish a new index instead of modifying the
+ *	current one, so lookups never wait for them.
+ *
+ *	Saving stores rows and columns in depth-first tag order (parents first, siblings in name order), so on load
+ *	every tag subtree occupies a contiguous [Begin, End) range of indexes. See GetRowRange and QuerySubtree.
+ *	Ranges are discarded as soon as rows or columns are edited, and come back on the next load.
+ *
  *	For example, assume the map Row(tag) = { a: 0, a.a: 1, b: 2 },
  *
  *		- appending b.a produces { ..., b.a: 3 }
@@ -103,6 +149,12 @@ public:
 	/** Invalid tag index designation */
 	static constexpr uint32 InvalidIndex = MAX_uint32;
 
+	/** Identifies a memory page (one per structure) for fast repeated queries. See GetPageIndex */
+	using PageIndex = int32;
+
+	/** Invalid page index designation */
+	static constexpr int32 InvalidPageIndex = INDEX_NONE;
+
 	/** Quickly identifies a cell by its row and column index */
 	struct Cell
 	{
@@ -110,6 +162,47 @@ public:
 		TagIndex Column;
 	};
 
+	/** A contiguous range of row or column indexes, [Begin, End) */
+	struct IndexRange
+	{
+		TagIndex Begin{ InvalidIndex };
+		TagIndex End{ InvalidIndex };
+
+		FORCEINLINE uint32 Num() const
+		{
+			return End - Begin;
+		}
+	};
+
+	/** A rectangular block of cells on a dense page, as produced by QuerySubtree */
+	struct CellBlock
+	{
+		/** Data of the first cell: (Rows.Begin, Columns.Begin) */
+		uint8* Data{ nullptr };
+
+		/** Distance in bytes between consecutive rows */
+		SIZE_T RowStride{ 0 };
+
+		/** Distance in bytes between consecutive columns */
+		SIZE_T CellStride{ 0 };
+
+		/** Rows in this block */
+		IndexRange Rows;
+
+		/** Columns in this block */
+		IndexRange Columns;
+
+		/**
+		 * Data of a cell in this block
+		 * @param Row Absolute row index, within Rows
+		 * @param Column Absolute column index, within Columns
+		 */
+		FORCEINLINE uint8* GetCellData(const TagIndex Row, const TagIndex Column) const
+		{
+			return Data + static_cast<SIZE_T>(Row - Rows.Begin) * RowStride + static_cast<SIZE_T>(Column - Columns.Begin) * CellStride;
+		}
+	};
+
 	/** Identifies a cell by its tags. Needs querying to yield an actual cell */
 	struct CellTags
 	{
@@ -126,6 +219,65 @@ public:
 	UPROPERTY(EditAnywhere, Category = Cells)
 	TArray<UScriptStruct*> Structures;
 
+	/** If true, QueryCached memoizes results. Worth it when the same tag pairs are queried repeatedly */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	bool bMemoizeQueries{ false };
+
+	/** Page properties to project into contiguous arrays on load, for vectorized scans. See GetProjectedValues */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	TArray<FAffinityTableProjectionSettings> Projections;
+
+	/**
+	 * If true, cooked pages that support raw images (see FAffinityTablePage::SupportsRawImage) are stored as bulk data,
+	 * and only loaded the first time they are accessed. Other pages always load with the table.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	bool bLoadPagesOnDemand{ false };
+
+	/**
+	 * If true, cooked pages that support raw images are stored as memory mapped bulk data. On platforms that support it,
+	 * those pages point straight into a read-only mapping of the cooked file, shared by every process that loads it.
+	 * Cells of mapped pages must not be written to.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	bool bMapCookedPages{ false };
+
+	/** If true, loading a table with mapped pages asks the OS to read them ahead. See PrefaultMappedPages */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	bool bPrefaultMappedPages{ false };
+
+	/**
+	 * Pages of these structures are kept compressed in memory after load, and expanded into a cache when accessed.
+	 * The cache is brought back within PageCacheBudgetKB by TrimPageCache. Applies to fixed-size pages of structures
+	 * that support raw images.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	TArray<UScriptStruct*> CompressedStructures;
+
+	/** Codec for compressed pages */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	FName PageCompressionFormat{ NAME_LZ4 };
+
+	/** Budget for expanded compressed pages, in KB. Zero uses the project-wide AffinityTable.PageCacheBudgetKB */
+	UPROPERTY(EditAnywhere, Category = Performance, meta = (ClampMin = 0))
+	int32 PageCacheBudgetKB{ 0 };
+
+	/**
+	 * Cells of these structures each start on their own cache line, so threads writing to neighbouring cells do not
+	 * contend for the same line. Costs memory on small structures, and these pages are never cooked as raw images.
+	 * Takes effect the next time the table is loaded.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance)
+	TArray<UScriptStruct*> CacheLinePaddedStructures;
+
+	/**
+	 * If nonzero, on-demand pages (see bLoadPagesOnDemand) are split into row partitions: rows sharing their tag up to
+	 * this depth (1 for "Region", 2 for "Region.North"...) load and release together. Pages with projections always
+	 * load whole. See RequestRowPartition.
+	 */
+	UPROPERTY(EditAnywhere, Category = Performance, meta = (ClampMin = 0))
+	int32 RowPartitionDepth{ 0 };
+
 	/** To retain row FGameplayTags in order.*/
 	UPROPERTY()
 	TArray<FGameplayTag> RowTags;
@@ -143,7 +295,13 @@ public:
 	virtual ~UAffinityTable() override;
 
 	// UObject Interface
+	virtual void PostInitProperties() override;
 	virtual void GetPreloadDependencies(TArray<UObject*>& OutDeps) override;
+	virtual void PostLoad() override;
+#if WITH_EDITOR
+	virtual void PreSave(FObjectPreSaveContext SaveContext) override;
+#endif
+	virtual void BeginDestroy() override;
 	// End of UObject Interface
 
 	/**
@@ -160,6 +318,34 @@ public:
 	 */
 	TagIndex GetColumnIndex(const FGameplayTag& InTag, bool ExactMatch = true) const;
 
+	/**
+	 * Provides the range of row indexes covered by the provided tag and all of its descendants.
+	 * Only available on hierarchy ordered tables (see Indexing).
+	 * @param InTag A row tag
+	 * @param OutRange Receives the range of the subtree
+	 * @return True if the tag is a row and we have ordered ranges
+	 */
+	bool GetRowRange(const FGameplayTag& InTag, IndexRange& OutRange) const;
+
+	/**
+	 * Provides the range of column indexes covered by the provided tag and all of its descendants.
+	 * Only available on hierarchy ordered tables (see Indexing).
+	 * @param InTag A column tag
+	 * @param OutRange Receives the range of the subtree
+	 * @return True if the tag is a column and we have ordered ranges
+	 */
+	bool GetColumnRange(const FGameplayTag& InTag, IndexRange& OutRange) const;
+
+	/**
+	 * Provides every cell under a row subtree against a column subtree as a single block of page memory.
+	 * Requires a hierarchy ordered table and a dense (fixed mode) page.
+	 * @param InRoots Root row and column tags of the subtrees. Must be exact matches
+	 * @param InPage Page to read, as provided by GetPageIndex
+	 * @param OutBlock Receives the block of cells
+	 * @return True if the block is available
+	 */
+	bool QuerySubtree(const CellTags& InRoots, PageIndex InPage, CellBlock& OutBlock) const;
+
 	/**
 	 * Retrieve in-memory data for a given cell/structure, or nullptr if the parameters are invalid
 	 * @param InCell cell address for the structure data
@@ -167,6 +353,21 @@ public:
 	 */
 	uint8* GetCellData(const Cell InCell, const UScriptStruct* InScriptStruct) const;
 
+	/**
+	 * Retrieve in-memory data for a given cell/page, or nullptr if the parameters are invalid. Cells of mapped pages
+	 * (see bMapCookedPages) are read-only: writing through the returned pointer faults.
+	 * @param InCell cell address for the structure data
+	 * @param InPage page index, as provided by GetPageIndex
+	 */
+	uint8* GetCellData(const Cell InCell, PageIndex InPage) const;
+
+	/**
+	 * Provides the index of the page that holds data for the provided structure, or InvalidPageIndex if we have none.
+	 * Page indexes remain valid until the table is reloaded or its structures change.
+	 * @param InScriptStruct Structure to look for
+	 */
+	PageIndex GetPageIndex(const UScriptStruct* InScriptStruct) const;
+
 	/**
 	 * Retrieve in-memory data for a given row/structure, or nullptr if the parameters are invalid
 	 * @param RowIndex index of the row for the structure data
@@ -175,6 +376,32 @@ public:
 	 */
 	void GetRowData(TagIndex RowIndex, const UScriptStruct* InScriptStruct, TArray<uint8*>& OutData) const;
 
+	/**
+	 * Retrieve in-memory data for a given column/structure, or nullptr if the parameters are invalid
+	 * @param ColumnIndex index of the column for the structure data
+	 * @param InScriptStruct expected structure type
+	 * @param OutData
+	 */
+	void GetColumnData(TagIndex ColumnIndex, const UScriptStruct* InScriptStruct, TArray<uint8*>& OutData) const;
+
+	/**
+	 * Provides the tag of a row by its index, or an invalid tag if the row does not exist
+	 * @param InIndex Row index
+	 */
+	FORCEINLINE FGameplayTag GetRowTag(const TagIndex InIndex) const
+	{
+		return RowIndexTags.IsValidIndex(InIndex) ? RowIndexTags[InIndex] : FGameplayTag::EmptyTag;
+	}
+
+	/**
+	 * Provides the tag of a column by its index, or an invalid tag if the column does not exist
+	 * @param InIndex Column index
+	 */
+	FORCEINLINE FGameplayTag GetColumnTag(const TagIndex InIndex) const
+	{
+		return ColumnIndexTags.IsValidIndex(InIndex) ? ColumnIndexTags[InIndex] : FGameplayTag::EmptyTag;
+	}
+
 	/**
 	 * Queries an affinity table for information contained at the intersection of the provided row and column.
 	 * @param InCellTags Coordinates of the requested cell
@@ -185,6 +412,18 @@ public:
 	 */
 	bool Query(const CellTags& InCellTags, bool ExactMatch, TArray<const UScriptStruct*>& InStructureTypes, TArray<FAffinityTableCellDataWrapper>& OutMemoryPtrs) const;
 
+	/**
+	 * Queries an affinity table for information contained at the intersection of the provided row and column.
+	 * Same as above, but pages are provided by index. Resolve them once with GetPageIndex to skip per-query structure lookups.
+	 * @param InCellTags Coordinates of the requested cell
+	 * @param ExactMatch If true, look for an exact Row Vs Column match. Otherwise find the closest tag
+	 * @param InPages The pages to return data from.
+	 * @param OutData Receives one pointer per page, in InPages order. Must hold at least InPages.Num() pointers. Missing
+	 *	data yields nullptr.
+ 	 * @return True if a match was found, and every requested page produced data.
+	 */
+	bool Query(const CellTags& InCellTags, bool ExactMatch, TConstArrayView<PageIndex> InPages, TArrayView<uint8*> OutData) const;
+
 	/**
 	 * Queries an affinity table for information contained at in the provided row.
 	 * @param RowTag Requested Row to get the data for
@@ -195,6 +434,297 @@ public:
 	 */
 	bool QueryForRow(const FGameplayTag& RowTag, bool ExactMatch, TArray<const UScriptStruct*>& InStructureTypes, TArray<FCellDataArrayWrapper>& OutMemoryPtrs) const;
 
+	/**
+	 * Queries an affinity table for information contained at in the provided column.
+	 * @param ColumnTag Requested Column to get the data for
+	 * @param ExactMatch If true, look for an exact Row Vs Column match. Otherwise find the closest tag
+	 * @param InStructureTypes The types of structure to return. These must be known to the table asset.
+	 * @param OutMemoryPtrs Pointers to hold data locations for the requested structures, InStructureTypes order.
+ 	 * @return True if a match was found.
+	 */
+	bool QueryForColumn(const FGameplayTag& ColumnTag, bool ExactMatch, TArray<const UScriptStruct*>& InStructureTypes, TArray<FCellDataArrayWrapper>& OutMemoryPtrs) const;
+
+	/**
+	 * Provides the projected values of a page property in row-major order (Row * Columns + Column), or an empty
+	 * view if the property is not projected. See Projections.
+	 * @param InPage Page index, as provided by GetPageIndex
+	 * @param PropertyName Name of a projected property
+	 */
+	TConstArrayView<float> GetProjectedValues(PageIndex InPage, FName PropertyName) const;
+
+	/**
+	 * Provides the projected values of a page property for a single row, or an empty view if the property is not projected.
+	 * @param InPage Page index, as provided by GetPageIndex
+	 * @param PropertyName Name of a projected property
+	 * @param Row Row index
+	 */
+	TConstArrayView<float> GetProjectedRowValues(PageIndex InPage, FName PropertyName, TagIndex Row) const;
+
+	/**
+	 * Rebuilds our property projections. Happens automatically on load and topology changes; call it
+	 * after writing cell data directly. Not thread safe.
+	 */
+	void RefreshProjections();
+
+	// Cell search
+	//
+	// Scans run over raw page memory, on worker threads for large pages. Results are sorted in row-major order.
+	// Use GetRowTag/GetColumnTag to translate matching cells back into tags.
+
+	/**
+	 * Finds all cells on a page whose data satisfies the provided predicate.
+	 * @param InPage Page to scan, as provided by GetPageIndex
+	 * @param Predicate Test for each cell's data. Must be safe to call from multiple threads
+	 * @param OutCells Receives matching cells
+	 * @param InSubtree If provided, only scan cells under these row and column tags. Invalid tags select the whole axis
+	 */
+	void FindCells(PageIndex InPage, TFunctionRef<bool(const uint8*)> Predicate, TArray<Cell>& OutCells, const CellTags* InSubtree = nullptr) const;
+
+	/**
+	 * Finds all cells on a page where a numeric property compares favorably against the provided value.
+	 * @param InPage Page to scan, as provided by GetPageIndex
+	 * @param PropertyPath Dot-separated path to a numeric property, which may go through nested structures (ie Stats.Damage)
+	 * @param Comparison Comparison to apply: (Property Comparison Value)
+	 * @param Value Value to compare against
+	 * @param OutCells Receives matching cells
+	 * @param InSubtree If provided, only scan cells under these row and column tags. Invalid tags select the whole axis
+	 * @return False if the page or property path are invalid
+	 */
+	bool FindCells(PageIndex InPage, const FString& PropertyPath, EAffinityTableComparison Comparison, double Value, TArray<Cell>& OutCells, const CellTags* InSubtree = nullptr) const;
+
+	// Cell iteration
+	//
+	// Zero-copy views over the cells of a row, a column or a whole page. See TAffinityTableCellRange.
+
+	/**
+	 * Iterates the cells of a row on the provided page
+	 * @param RowTag Requested row
+	 * @param ExactMatch If true, look for an exact match. Otherwise find the closest tag
+	 * @param InPage Page to iterate, as provided by GetPageIndex
+	 */
+	TAffinityTableCellRange<uint8> GetRowCells(const FGameplayTag& RowTag, bool ExactMatch, PageIndex InPage) const;
+
+	/**
+	 * Iterates the cells of a column on the provided page
+	 * @param ColumnTag Requested column
+	 * @param ExactMatch If true, look for an exact match. Otherwise find the closest tag
+	 * @param InPage Page to iterate, as provided by GetPageIndex
+	 */
+	TAffinityTableCellRange<uint8> GetColumnCells(const FGameplayTag& ColumnTag, bool ExactMatch, PageIndex InPage) const;
+
+	/**
+	 * Iterates all cells of the provided page
+	 * @param InPage Page to iterate, as provided by GetPageIndex
+	 */
+	TAffinityTableCellRange<uint8> GetPageCells(PageIndex InPage) const;
+
+	/** Typed GetRowCells for the page of structure T */
+	template <typename T>
+	TAffinityTableCellRange<const T> GetRowCells(const FGameplayTag& RowTag, const bool ExactMatch) const
+	{
+		const TagIndex Row = GetRowIndex(RowTag, ExactMatch);
+		return MakeCellRange<const T>(GetPageIndex(T::StaticStruct()), Row, Row == InvalidIndex ? Row : Row + 1, 0, MAX_uint32);
+	}
+
+	/** Typed GetColumnCells for the page of structure T */
+	template <typename T>
+	TAffinityTableCellRange<const T> GetColumnCells(const FGameplayTag& ColumnTag, const bool ExactMatch) const
+	{
+		const TagIndex Column = GetColumnIndex(ColumnTag, ExactMatch);
+		return MakeCellRange<const T>(GetPageIndex(T::StaticStruct()), 0, MAX_uint32, Column, Column == InvalidIndex ? Column : Column + 1);
+	}
+
+	/** Typed GetPageCells for the page of structure T */
+	template <typename T>
+	TAffinityTableCellRange<const T> GetPageCells() const
+	{
+		return MakeCellRange<const T>(GetPageIndex(T::StaticStruct()), 0, MAX_uint32, 0, MAX_uint32);
+	}
+
+	/**
+	 * Queries data for many cells in one call. Each unique tag is resolved once, and the batch is then
+	 * executed as a pre-resolved cell batch (see below). Scratch memory comes from the calling thread's FMemStack, so
+	 * batches do not allocate on the heap.
+	 * @param InCellTags Coordinates of the requested cells
+	 * @param ExactMatch If true, look for exact Row Vs Column matches. Otherwise find the closest tags
+	 * @param InPages The pages to return data from, as provided by GetPageIndex
+	 * @param OutData Receives InCellTags.Num() x InPages.Num() pointers: for cell i and page p, OutData[i * InPages.Num() + p].
+	 *	Missing data yields nullptr.
+	 * @param AllowParallel If true, large batches are split across worker threads
+	 * @return Number of cells for which all requested pages produced data
+	 */
+	int32 QueryBatch(TConstArrayView<CellTags> InCellTags, bool ExactMatch, TConstArrayView<PageIndex> InPages, TArrayView<uint8*> OutData, bool AllowParallel = false) const;
+
+	/**
+	 * Queries data for many pre-resolved cells in one call. Pages are resolved once for the whole batch, and the row
+	 * partitions it needs are loaded before any cell is read.
+	 * @param InCells Cells to query. Cells with invalid indexes yield nullptr.
+	 * @param InPages The pages to return data from, as provided by GetPageIndex
+	 * @param OutData Receives InCells.Num() x InPages.Num() pointers: for cell i and page p, OutData[i * InPages.Num() + p].
+	 * @param AllowParallel If true, large batches are split across worker threads
+	 * @return Number of cells for which all requested pages produced data
+	 */
+	int32 QueryBatch(TConstArrayView<Cell> InCells, TConstArrayView<PageIndex> InPages, TArrayView<uint8*> OutData, bool AllowParallel = false) const;
+
+	/**
+	 * Queries an affinity table for information contained at the intersection of the provided row and column,
+	 * going through our memoization cache if it is enabled. Results are only memoized once the cell is resident on
+	 * every page, and keyed by tag net index, so tags unknown to the tags manager are never memoized. Safe to call
+	 * from multiple threads.
+	 * @param InCellTags Coordinates of the requested cell
+	 * @param ExactMatch If true, look for an exact Row Vs Column match. Otherwise find the closest tag
+	 * @param InPages The pages to return data from, as provided by GetPageIndex
+	 * @param OutData Receives one pointer per requested page, or nullptr if there is no data
+	 * @return True if all requested pages produced data
+	 */
+	bool QueryCached(const CellTags& InCellTags, bool ExactMatch, TConstArrayView<PageIndex> InPages, TArrayView<uint8*> OutData) const;
+
+	/**
+	 * Enables or disables query memoization. Disabling drops all memoized results.
+	 * Not thread safe: do not call while other threads are querying this table.
+	 * @param Enabled True to memoize QueryCached results
+	 */
+	void SetQueryCacheEnabled(bool Enabled);
+
+	/**
+	 * Retrieves hit and miss counts for our memoization cache. Both are zero if the cache is disabled.
+	 * @param OutHits Number of queries answered from the cache
+	 * @param OutMisses Number of queries that had to be resolved
+	 */
+	void GetQueryCacheStats(uint64& OutHits, uint64& OutMisses) const;
+
+	/**
+	 * Provides the current table epoch. The epoch advances whenever rows, columns or pages change, invalidating
+	 * any data pointers obtained under a previous epoch.
+	 */
+	FORCEINLINE uint32 GetEpoch() const
+	{
+		return Epoch.load(std::memory_order_acquire);
+	}
+
+	/**
+	 * Repacks the cells of dynamic pages in row-major order, and frees the memory left behind by deleted rows and
+	 * columns. Runs before every package save, see PreSave. Advances the epoch if any cell moved: like ReleaseIdlePages, only call
+	 * this when no other thread is querying the table. Returns the number of compacted pages.
+	 */
+	int32 CompactPages();
+
+	// On-demand pages
+	//
+	// Pages cooked with bLoadPagesOnDemand are loaded on first access by any query. Loading is thread safe.
+
+	/**
+	 * True if the cells of the provided page are in memory
+	 * @param InPage Page index
+	 */
+	bool IsPageResident(PageIndex InPage) const;
+
+	/**
+	 * Releases on-demand pages that have not been accessed for the provided number of frames. They load again on their
+	 * next access. Advances the epoch: data pointers into released pages become invalid, so only call this when no
+	 * other thread is querying the table. Returns the number of released pages.
+	 * @param IdleFrames Minimum number of frames since the last access
+	 */
+	int32 ReleaseIdlePages(uint64 IdleFrames);
+
+	// Row partitions
+	//
+	// With RowPartitionDepth set, on-demand pages reserve address space on first access, and only load the rows
+	// that are queried, one partition at a time. Queries block until their partition is loaded. Request partitions
+	// ahead of time to load them asynchronously instead.
+
+	/**
+	 * Starts loading the partition containing the provided row on every partitioned page. Does not wait.
+	 * @param InRow Any row tag in the partition, or its partition root
+	 */
+	void RequestRowPartition(const FGameplayTag& InRow) const;
+
+	/**
+	 * True if the partition containing the provided row is loaded on every partitioned page
+	 * @param InRow Any row tag in the partition, or its partition root
+	 */
+	bool IsRowPartitionResident(const FGameplayTag& InRow) const;
+
+	/**
+	 * Returns the memory of a partition to the OS. It loads again on its next query. Advances the epoch: like
+	 * ReleaseIdlePages, only call this when no other thread is querying the table.
+	 * @param InRow Any row tag in the partition, or its partition root
+	 */
+	void ReleaseRowPartition(const FGameplayTag& InRow);
+
+	/**
+	 * Brings mapped pages (see bMapCookedPages) into physical memory, so first queries do not stall on page faults.
+	 * @param Blocking If true, touch every page now. Otherwise only hint the OS to read them ahead, on Unix and Windows.
+	 */
+	void PrefaultMappedPages(bool Blocking) const;
+
+	/**
+	 * Releases expanded compressed pages (see CompressedStructures), least recently used first, until they fit in our
+	 * budget. Accessing pages never releases others, as readers on other threads may still hold their cells, so the
+	 * cache can go over budget until this runs. Advances the epoch if anything is released: like ReleaseIdlePages,
+	 * only call this when no other thread is querying the table, for instance once per frame. Returns the number of
+	 * released pages.
+	 */
+	int32 TrimPageCache();
+
+	/**
+	 * Retrieves compressed page cache statistics.
+	 * @param OutHits Frames in which an expanded compressed page was used without expanding it again
+	 * @param OutMisses Accesses that had to expand a compressed page
+	 * @param OutEvictions Compressed pages released to stay in budget, or by ReleaseIdlePages
+	 */
+	void GetPageCacheStats(uint64& OutHits, uint64& OutMisses, uint64& OutEvictions) const;
+
+	/**
+	 * Writes the memory usage of every page: datablocks, their capacity, and the bytes not taken by cells. Use it to
+	 * tune AffinityTable.DatablockTargetKB. Also available for every loaded table as AffinityTable.DumpMemoryStats.
+	 * @param Ar Device to write to
+	 */
+	void DumpMemoryStats(FOutputDevice& Ar) const;
+
+	// Typed native queries
+	//
+	// These do not allocate, log, or go through blueprint wrappers. Data is typed after the requested structure,
+	// which must be a native USTRUCT with a page in this table. Results are nullptr when there is no match.
+
+	/**
+	 * Finds the data of type T contained at the intersection of the provided row and column.
+	 * @param InCellTags Coordinates of the requested cell
+	 * @param ExactMatch If true, look for an exact Row Vs Column match. Otherwise find the closest tag
+	 */
+	template <typename T>
+	const T* Find(const CellTags& InCellTags, const bool ExactMatch) const
+	{
+		return Find<T>(Cell{ GetRowIndex(InCellTags.Row, ExactMatch), GetColumnIndex(InCellTags.Column, ExactMatch) });
+	}
+
+	/**
+	 * Finds the data of type T contained in the provided cell.
+	 * @param InCell A cell, as resolved by GetRowIndex/GetColumnIndex. Invalid indexes yield nullptr.
+	 */
+	template <typename T>
+	const T* Find(const Cell InCell) const
+	{
+		if (InCell.Row == InvalidIndex || InCell.Column == InvalidIndex)
+		{
+			return nullptr;
+		}
+		return reinterpret_cast<const T*>(GetCellData(InCell, GetPageIndex(T::StaticStruct())));
+	}
+
+	/**
+	 * Finds data for several structures at the intersection of the provided row and column. Tags are resolved only once.
+	 * @param InCellTags Coordinates of the requested cell
+	 * @param ExactMatch If true, look for an exact Row Vs Column match. Otherwise find the closest tag
+	 * @return One pointer per requested type, in template argument order
+	 */
+	template <typename... Ts>
+	TTuple<const Ts*...> FindMany(const CellTags& InCellTags, const bool ExactMatch) const
+	{
+		const Cell QueriedCell{ GetRowIndex(InCellTags.Row, ExactMatch), GetColumnIndex(InCellTags.Column, ExactMatch) };
+		return MakeTuple(Find<Ts>(QueriedCell)...);
+	}
+
 #if WITH_EDITOR
 
 	/**
@@ -209,6 +739,15 @@ public:
 	 */
 	void SetStructureChangeCallback(const StructureChangeCallback& InCallback);
 
+	/** Callback for CompactPages moving our cells. Pointers to cell data must be retrieved again */
+	using CellsMovedCallback = std::function<void()>;
+
+	/**
+	 * Assigns a callback for cell relocation notification
+	 * @param InCallback A correctly-formed callback
+	 */
+	void SetCellsMovedCallback(const CellsMovedCallback& InCallback);
+
 	/**
 	 * Reacts to changes on this object's properties
 	 * @param PropertyChangedEvent Data about the property that changed
@@ -311,6 +850,32 @@ public:
 	 * @return True if the data contained by the cells is identical
 	 */
 	bool AreCellsIdentical(const UScriptStruct* Struct, const Cell& CellA, const Cell& CellB) const;
+
+	/**
+	 * Copies the structured data of a cell over another, and marks the overwritten cell dirty.
+	 *
+	 * @param Struct A structure that describes the memory space of the cells
+	 * @param From Cell to copy
+	 * @param To Cell to overwrite
+	 * @return True if both cells exist and the data was copied
+	 */
+	bool CopyCell(const UScriptStruct* Struct, const Cell& From, const Cell& To);
+
+	/**
+	 * Marks a cell as changed since our last save. Saves reuse the serialized form of clean cells, so code that writes
+	 * through GetCellData must call this for the change to be saved. New rows and columns start dirty.
+	 * @param InStruct Structure of the page that holds the cell
+	 * @param InCell Cell that changed
+	 */
+	void MarkCellDirty(const UScriptStruct* InStruct, const Cell& InCell);
+
+	/**
+	 * Retrieve in-memory data of a cell in order to write it, or nullptr if the parameters are invalid. The cell is
+	 * marked dirty, so editor code that changes cells should get their data from here rather than GetCellData.
+	 * @param InCell cell address for the structure data
+	 * @param InScriptStruct expected structure type
+	 */
+	uint8* GetMutableCellData(const Cell InCell, const UScriptStruct* InScriptStruct);
 #endif
 
 protected:
@@ -329,48 +894,400 @@ protected:
 	void AllocatePageMemory(uint32 InRows, uint32 InColumns);
 
 private:
+	/** Automation tests drive our encoders and loaders directly, see AffinityTableTests.cpp */
+	friend struct FAffinityTableTestAccess;
+
 	/** Defines a map of inheritance connections */
 	using InheritanceMap = TMap<FString, CellTags>;
 
-	/**
-	 * Loads data for this asset from the provided file. All other contents are deleted.
-	 * @param Ar Archive with a previously saved table
-	 */
-	void LoadTable(FArchive& Ar);
+	/** How the cells of a page are stored in our archive */
+	enum class EPageEncoding : uint8
+	{
+		/** Per-cell tagged serialization. Written by older formats, superseded by Cells */
+		Tagged,
 
-	/**
-	 * Takes the row and column arrays and uses them to populate respective map indexes.
-	 * Used by our loading sequences.
-	 */
-	void GenerateRowAndColumnMaps();
+		/** Raw memory image of the page plus Cells fallback. Written for cooked plain-data pages */
+		RawImage,
 
-	// Compatibility migrations.
-	//
-	// These functions implement a FULL loading procedure (minus the version check), plus any required
-	// compatibility operations in order to leave the table in a functional state.
+		/** Like RawImage, with the image in bulk data. Loaded on first access or memory mapped, see bLoadPagesOnDemand */
+		OnDemandImage,
 
-	/** Loads an affinity table at V3 */
-	void LoadTable_V3(FArchive& Ar);
+		/** Cells serialized on their own, with names and objects by path. Written for editor saves, see MarkCellDirty */
+		CellBlob,
 
-	/**
-	 * Clears all data on this table, freeing up all memory utilized by any existing structures.
-	 * Does not touch exposed properties. Failing to re-allocate structure memory after this call
-	 * will result in memory exceptions.
-	 */
-	void ClearTable();
+		/** Cell schema and cells in schema order, see SaveCells. Written for cooked pages without a raw image */
+		Cells
+	};
 
-#if WITH_EDITOR
-	/**
-	 * Saves the contents of this asset
+	/** A property as written by SerializeCell, see CellSchema */
+	struct SchemaProperty
+	{
+		FString Name;
+
+		/** C++ type of the property, including template arguments */
+		FString Type;
+
+		int32 ArrayDim = 1;
+
+		bool operator==(const SchemaProperty& Other) const
+		{
+			return ArrayDim == Other.ArrayDim && Name == Other.Name && Type == Other.Type;
+		}
+
+		friend FArchive& operator<<(FArchive& Ar, SchemaProperty& Property)
+		{
+			return Ar << Property.Name << Property.Type << Property.ArrayDim;
+		}
+	};
+
+	/** Properties of a structure in the order their cells were written. Saved ahead of the cells of a page */
+	struct CellSchema
+	{
+		/** Layout hash of the structure, see FAffinityTablePage::ComputeLayoutHash */
+		uint32 LayoutHash = 0;
+
+		TArray<SchemaProperty> Properties;
+
+		friend FArchive& operator<<(FArchive& Ar, CellSchema& Schema)
+		{
+			return Ar << Schema.LayoutHash << Schema.Properties;
+		}
+	};
+
+	/** How SerializeCell reads a saved property */
+	enum class EMigration : uint8
+	{
+		/** The property did not change */
+		Copy,
+
+		/** The property is gone, or cannot be converted. Its cells keep their default value */
+		Skip,
+
+		/** Numeric conversions, by saved type */
+		FromBool,
+		FromInt8,
+		FromInt16,
+		FromInt32,
+		FromInt64,
+		FromUInt8,
+		FromUInt16,
+		FromUInt32,
+		FromUInt64,
+		FromFloat,
+		FromDouble
+	};
+
+	/** A single property of a migration plan, see BuildMigrationPlan */
+	struct MigrationStep
+	{
+		/** Property that receives the saved values. Null if they are skipped */
+		const FProperty* Property = nullptr;
+
+		EMigration Migration = EMigration::Skip;
+
+		/** Number of saved values */
+		int32 ArrayDim = 1;
+	};
+
+	/** Serialized form of a single cell, see EPageEncoding::CellBlob */
+	struct CellRecord
+	{
+		/** Cell data. Does not depend on the archive it is written to */
+		TArray<uint8> Bytes;
+
+		/** Objects referenced by the cell */
+		TArray<TWeakObjectPtr<UObject>> References;
+
+		/** Path of each object in References, as written in Bytes */
+		TArray<FString> ReferencePaths;
+
+		/** Soft object paths referenced by the cell */
+		TArray<FSoftObjectPath> SoftReferences;
+	};
+
+	/** Cells of a CellBlob page, read by Serialize and decoded by BuildPendingPages. See LoadCellBlob */
+	struct CellBlobPayload
+	{
+		CellSchema Schema;
+
+		/** Custom versions the cells were written with */
+		TMap<FGuid, int32> CustomVersions;
+
+		bool bRequiresLocalizationGather = false;
+
+		/** Objects referenced by the cells, loaded through our archive. Cells find them again by path */
+		TArray<UObject*> References;
+
+		/** Soft object paths referenced by the cells, announced to our archive */
+		TArray<FSoftObjectPath> SoftReferences;
+
+		/** Cells, see FAffinityTableCellArchive */
+		TArray<uint8> Bytes;
+
+		/** Engine versions of the archive the cells were read from */
+		FPackageFileVersion UEVer;
+		int32 LicenseeUEVer = 0;
+	};
+
+	/** Serialized cells of a page, reused by saves until the cells change */
+	struct SavedPage
+	{
+		/** Records by row index * Columns + column index */
+		TArray<CellRecord> Cells;
+
+		/** Cells that must be serialized again */
+		TBitArray<> DirtyCells;
+
+		/** Column count of the page when the records were made */
+		uint32 Columns = 0;
+
+		/** Layout hash of the structure when the records were made */
+		uint32 LayoutHash = 0;
+
+		/** Custom versions used by our records. Saves announce them to their archive */
+		TSet<FGuid> CustomVersions;
+
+		/** True if any record holds localizable text */
+		bool bRequiresLocalizationGather = false;
+	};
+
+	/** Source data of an on-demand or compressed page, and its residency */
+	struct PageImage
+	{
+		/** Image of an on-demand page. Unused for compressed pages */
+		FByteBulkData BulkData;
+
+		/** Image of a compressed page, see PageCompressionFormat */
+		TArray<uint8> CompressedData;
+
+		/** Size of the expanded image of a compressed page */
+		int64 UncompressedSize = 0;
+
+		/** True once the image has been copied into the page, or the page points into its mapping */
+		std::atomic<bool> bResident{ false };
+
+		/** Frame of the last access, for ReleaseIdlePages */
+		std::atomic<uint64> LastAccessFrame{ 0 };
+
+		/**
+		 * Row partition states, by partition index. Empty unless the page is partitioned. Sized once by
+		 * BuildPendingPages and never resized: load callbacks write to their state from IO threads.
+		 */
+		TArray<std::atomic<uint8>> PartitionStates;
+
+		/**
+		 * In-flight partition loads, by partition index. The array is guarded by PageImageLock. Requests are shared, so
+		 * LoadRowPartitions can wait on them after releasing the lock.
+		 */
+		TArray<TSharedPtr<IBulkDataIORequest, ESPMode::ThreadSafe>> PartitionRequests;
+
+		/** Waits for and discards in-flight partition loads */
+		~PageImage();
+	};
+
+	/** Row partition states. See RowPartitionDepth */
+	enum class EPartitionState : uint8
+	{
+		Unloaded,
+		Loading,
+		Resident
+	};
+
+	/** Location of a section of our archive, relative to the end of the table directory */
+	struct SectionEntry
+	{
+		int64 Offset = 0;
+		int64 Size = 0;
+
+		friend FArchive& operator<<(FArchive& Ar, SectionEntry& Entry)
+		{
+			return Ar << Entry.Offset << Entry.Size;
+		}
+	};
+
+	/** Table directory entry for a single page */
+	struct PageEntry
+	{
+		FString StructName;
+		int32 Footprint = 0;
+		uint8 Encoding = 0;
+		SectionEntry Section;
+
+		friend FArchive& operator<<(FArchive& Ar, PageEntry& Entry)
+		{
+			return Ar << Entry.StructName << Entry.Footprint << Entry.Encoding << Entry.Section;
+		}
+	};
+
+	/** Page data captured by Serialize, and turned into a page by BuildPendingPages */
+	struct PendingPage
+	{
+		/** Structure of the page */
+		UScriptStruct* Struct = nullptr;
+
+		/** Structure size when the table was saved */
+		int32 Footprint = 0;
+
+		/** Raw image of the cells, allocated with FMemory::Malloc. Null unless the page has a RawImage encoding */
+		uint8* RawImage = nullptr;
+
+		/**
+		 * Page already decoded by Serialize. Tagged data and schema ordered cells (see SaveCells) name objects by their
+		 * index in the linker of our archive, so they can only be read from it.
+		 */
+		TSharedPtr<FAffinityTablePage> Page;
+
+		/** Cells of a CellBlob page. They name objects by path, so they are decoded later, by BuildPendingPages */
+		TUniquePtr<CellBlobPayload> Blob;
+
+		/** Image of an on-demand or compressed page */
+		TUniquePtr<PageImage> Image;
+
+#if WITH_EDITORONLY_DATA
+		/** Cell records read along with a CellBlob page */
+		SavedPage Saved;
+#endif
+
+		~PendingPage()
+		{
+			FMemory::Free(RawImage);
+		}
+	};
+
+	/**
+	 * Loads data for this asset from the provided file. All other contents are deleted.
+	 * @param Ar Archive with a previously saved table
+	 */
+	void LoadTable(FArchive& Ar);
+
+	/**
+	 * Takes the row and column arrays and uses them to populate respective map indexes.
+	 * Used by our loading sequences.
+	 */
+	void GenerateRowAndColumnMaps();
+
+	/**
+	 * Turns the pages captured by LoadTable into resident pages, and rebuilds everything derived from them.
+	 * Pages are independent, so they are built in parallel.
+	 */
+	void BuildPendingPages();
+
+	/** Waits for the page build started by PostLoad, if any. Queries do this before touching pages */
+	FORCEINLINE void EnsurePagesBuilt() const
+	{
+		if (UNLIKELY(bPagesPending.load(std::memory_order_acquire)))
+		{
+			WaitForPageBuild();
+		}
+	}
+
+	/** Slow path of EnsurePagesBuilt */
+	void WaitForPageBuild() const;
+
+	// Loading sections.
+	//
+	// Every supported format version goes through the same readers, which take the version of the archive
+	// and only differ where the format did.
+
+	/**
+	 * Reads the page directory of a v6 or later archive, the pages it lists, and the sections that follow them.
+	 * @param Ar Archive positioned after our row and column maps
+	 * @param Version Format version of the archive
+	 */
+	void LoadPageDirectory(FArchive& Ar, uint32 Version);
+
+	/**
+	 * Reads the pages of an archive older than v6, stored one after the other without a directory, and the
+	 * sections that follow them. Stops at the first page without a structure, as nothing after it can be located.
+	 * @param Ar Archive positioned after our row and column maps
+	 * @param Version Format version of the archive
+	 */
+	void LoadPageSequence(FArchive& Ar, uint32 Version);
+
+	/**
+	 * Captures the data of a page that does not need our archive to be turned into a page: raw and on-demand images,
+	 * and cell blobs. BuildPendingPages builds those pages.
+	 * @param Ar Archive positioned at the page data
+	 * @param Pending Page to capture, with its structure set
+	 * @param Encoding Encoding of the page, see EPageEncoding
+	 * @return False if the page has neither, or its image does not match the page. The page must be decoded then.
+	 */
+	bool CapturePage(FArchive& Ar, PendingPage& Pending, uint8 Encoding);
+
+	/**
+	 * Decodes the cells of a page from our archive. Images are skipped in favour of the cells that follow them.
+	 * Cell blobs are captured instead, see CapturePage.
+	 * @param Ar Archive positioned at the page data
+	 * @param Pending Page to decode, with its structure set. Its page is created if it has none yet
+	 * @param Encoding Encoding of the page, see EPageEncoding
+	 * @param Version Format version of the archive
+	 */
+	void DecodePage(FArchive& Ar, PendingPage& Pending, uint8 Encoding, uint32 Version);
+
+	/**
+	 * Reads our inheritance graph.
+	 * @param Ar Archive positioned at the graph
+	 */
+	void LoadInheritanceMaps(FArchive& Ar);
+
+	/**
+	 * Clears all data on this table, freeing up all memory utilized by any existing structures.
+	 * Does not touch exposed properties. Failing to re-allocate structure memory after this call
+	 * will result in memory exceptions.
+	 */
+	void ClearTable();
+
+#if WITH_EDITOR
+	/**
+	 * Saves the contents of this asset
 	 * @param Ar Archive to save our table into
 	 */
 	void SaveTable(FArchive& Ar);
 
 	/**
 	 * Ensure that our tag hierarchy is continuous.
-	 * Discontinuities happen when tags are deleted or renamed.
+	 * Discontinuities happen when tags are deleted or renamed. Orphans are deleted, so our pages must be built.
 	 */
 	void EnsureTagHierarchy();
+
+	/** True if EnsureTagHierarchy has anything to delete. Does not need our pages */
+	bool HasOrphanTags() const;
+
+	/**
+	 * Finds the tags whose ancestors are missing from the provided tags.
+	 * @param Tags Row or column tags
+	 * @param OutOrphans Receives the tags with a broken hierarchy
+	 */
+	static void FindOrphanTags(const TArray<FGameplayTag>& Tags, TSet<FGameplayTag>& OutOrphans);
+
+	/**
+	 * Renames the tags of our rows, columns, colors and inheritance links that have gameplay tag redirects. Tags under
+	 * a redirected parent follow it if their new tag exists. Every tag is resolved once, and the rename is applied in
+	 * place, so cells keep their data. Must run before EnsureTagHierarchy, which deletes the rows it cannot place.
+	 */
+	void RedirectTags();
+
+	/**
+	 * Adds a row for the provided tag and any missing ancestors. Does not rebuild our resolution index, see AddRow.
+	 * @param InTag Tag to add
+	 */
+	bool AddRowTag(const FGameplayTag& InTag);
+
+	/**
+	 * Adds a column for the provided tag and any missing ancestors. Does not rebuild our resolution index, see AddColumn.
+	 * @param InTag Tag to add
+	 */
+	bool AddColumnTag(const FGameplayTag& InTag);
+
+	/** Lays out the records of our saved pages for the current page dimensions, keeping those of existing cells */
+	void ResizeSavedPages();
+
+	/**
+	 * True if a record still names its references by their current paths, so serializing the cell again would not
+	 * change them.
+	 * @param Record Record to check
+	 */
+	static bool IsRecordCurrent(const CellRecord& Record);
 #endif
 
 	/**
@@ -386,6 +1303,95 @@ private:
 	 */
 	void SerializePage(FArchive& Ar, const FAffinityTablePage* Page, UScriptStruct* Struct);
 
+	/**
+	 * Reads a page saved with EPageEncoding::CellBlob, without decoding its cells
+	 * @param Ar The archive we are reading from
+	 * @param OutBlob Receives the cells
+	 */
+	static void ReadCellBlob(FArchive& Ar, CellBlobPayload& OutBlob);
+
+	/**
+	 * Decodes the cells read by ReadCellBlob. Does not need the archive they were read from, so it can run on any
+	 * thread while garbage collection is blocked. Only the game thread loads objects the cells reference by path
+	 * that are not loaded yet.
+	 * @param Blob The cells to decode
+	 * @param Page The page that receives the data
+	 * @param Struct The structure that corresponds to this page
+	 * @param OutSaved If not null, receives the records of the cells, so the next save can reuse them
+	 */
+	void LoadCellBlob(const CellBlobPayload& Blob, const FAffinityTablePage* Page, UScriptStruct* Struct, SavedPage* OutSaved) const;
+
+	/**
+	 * Builds the page of a captured cell blob, and compresses it if it should be.
+	 * @param Pending Page with a captured blob
+	 */
+	void BuildBlobPage(PendingPage& Pending) const;
+
+	/**
+	 * Writes the schema of a structure, followed by the cells of its page in schema order. Cells carry no property tags,
+	 * the schema is resolved once per page on load. See LoadCells.
+	 * @param Ar The archive we are writing to
+	 * @param Page The page that holds the data
+	 * @param Struct The structure that corresponds to this page
+	 */
+	void SaveCells(FArchive& Ar, const FAffinityTablePage* Page, UScriptStruct* Struct);
+
+	/**
+	 * Reads the cells written by SaveCells. Cells of a structure that changed since are migrated, see BuildMigrationPlan.
+	 * @param Ar The archive we are reading from
+	 * @param Page The page that receives the data
+	 * @param Struct The structure that corresponds to this page
+	 */
+	void LoadCells(FArchive& Ar, const FAffinityTablePage* Page, UScriptStruct* Struct);
+
+	/**
+	 * Describes the properties of a structure that SerializeCell writes to an archive
+	 * @param Struct The structure to describe
+	 * @param Ar The archive cells are written to. Properties it does not serialize are left out
+	 * @param OutSchema Receives the schema of the structure
+	 * @param OutPlan Receives the plan that writes cells in schema order
+	 */
+	static void BuildCellSchema(const UScriptStruct* Struct, FArchive& Ar, CellSchema& OutSchema, TArray<MigrationStep>& OutPlan);
+
+	/**
+	 * Resolves the properties of a saved schema against the current structure. Properties are matched by name, following
+	 * property redirects, and numeric properties are converted to their new type.
+	 * @param Struct The current structure
+	 * @param Ar The archive cells are read from
+	 * @param Schema The saved schema
+	 * @param OutPlan Receives one step per saved property
+	 * @return True if the schema did not change, so cells are read exactly as they were written
+	 */
+	bool BuildMigrationPlan(const UScriptStruct* Struct, FArchive& Ar, const CellSchema& Schema, TArray<MigrationStep>& OutPlan) const;
+
+	/**
+	 * Serializes a single cell in or out of the provided archive, one size-prefixed property at a time
+	 * @param Ar The archive we are reading or writing to
+	 * @param Plan Properties of the cell, see BuildCellSchema and BuildMigrationPlan
+	 * @param Data The cell
+	 */
+	static void SerializeCell(FArchive& Ar, TConstArrayView<MigrationStep> Plan, void* Data);
+
+	/**
+	 * Reads a saved numeric value and stores it into a numeric or boolean property of a different type
+	 * @param Ar The archive we are reading from
+	 * @param Migration Type of the saved value
+	 * @param Property The property that receives the value
+	 * @param Value Address of the property value
+	 */
+	static void ConvertValue(FArchive& Ar, EMigration Migration, const FProperty* Property, void* Value);
+
+#if WITH_EDITOR
+	/**
+	 * Writes the cells of a page with EPageEncoding::CellBlob. The records of clean cells that still name their
+	 * references by current paths are copied through, and every other cell is serialized again. See MarkCellDirty.
+	 * @param Ar The archive we are writing to
+	 * @param InPage Index of the page
+	 * @param Struct The structure that corresponds to this page
+	 */
+	void SaveCellBlob(FArchive& Ar, PageIndex InPage, UScriptStruct* Struct);
+#endif
+
 	/**
 	 * Make a single hashable string for the provided cell
 	 * @param InCell The cell to hash
@@ -395,10 +1401,39 @@ private:
 	/**
 	 * Finds a tag index in the provided map
 	 * @param InMap map to search
+	 * @param InResolution Closest-match resolution index for InMap. May be empty, in which case we walk the tag hierarchy
 	 * @param InTag Valid tag
 	 * @param ExactMatch If true, only an exact match is valid
 	 */
-	static TagIndex GetIndex(const TMap<FGameplayTag, TagIndex>& InMap, const FGameplayTag& InTag, bool ExactMatch);
+	static TagIndex GetIndex(const TMap<FGameplayTag, TagIndex>& InMap, const TArray<TagIndex>& InResolution, const FGameplayTag& InTag, bool ExactMatch);
+
+	/**
+	 * Builds a closest-match resolution index for the provided map: one entry per tag known to the
+	 * tags manager, addressed by tag net index.
+	 * @param InMap Row or column map to resolve against
+	 * @param OutResolution Receives the resolved index for every known tag
+	 */
+	static void BuildResolutionIndex(const TMap<FGameplayTag, TagIndex>& InMap, TArray<TagIndex>& OutResolution);
+
+	/**
+	 * Builds new resolution indexes off to the side and publishes them in a single swap, see Resolution. Queries keep
+	 * reading the previous indexes until then. Closest matches change with the tag tree, so this also advances our
+	 * epoch to drop memoized queries.
+	 * @param RebuildRows If false, the new resolution keeps the current row index
+	 * @param RebuildColumns If false, the new resolution keeps the current column index
+	 */
+	void RebuildResolutionIndexes(bool RebuildRows = true, bool RebuildColumns = true);
+
+	/**
+	 * Frees the resolutions replaced by RebuildResolutionIndexes. Only safe while no query runs, like topology edits.
+	 */
+	void ReleaseRetiredResolutions();
+
+	/**
+	 * Starts rebuilding our resolution indexes whenever the gameplay tag tree changes. Game thread only. Class default
+	 * objects and archetypes never query, so they do not follow the tree.
+	 */
+	void FollowTagTree();
 
 	/**
 	 * Verify that the provided structure is loaded. Attempt to load if necessary.
@@ -412,12 +1447,253 @@ private:
 	 */
 	FAffinityTablePage* GetPageForStruct(const UScriptStruct* InScriptStruct) const;
 
+	/** Regenerates our structure to page index lookup. Call after any change to Pages */
+	void RebuildPageIndexes();
+
+	/**
+	 * Gathers the valid indexes of an axis, optionally limited to the subtree of a tag.
+	 * @param InIndexTags Row or column tags by index
+	 * @param InRanges Subtree ranges for the axis. May be empty
+	 * @param InRoot Root of the subtree, or an invalid tag for the whole axis
+	 * @param Count Number of indexes on the page for this axis
+	 * @param OutIndexes Receives the selected indexes, in order
+	 */
+	static void GatherAxisIndexes(const TArray<FGameplayTag>& InIndexTags, const TMap<FGameplayTag, IndexRange>& InRanges, const FGameplayTag& InRoot, uint32 Count, TArray<TagIndex>& OutIndexes);
+
+	/** Marks a change in the topology of this table. See GetEpoch. Mutators refresh projections themselves, once per public call */
+	void AdvanceEpoch();
+
+	/**
+	 * Retrieves a page, loading its cells first if it is an on-demand page that is not resident.
+	 * Returns nullptr for invalid indexes.
+	 * @param InPage Page index
+	 */
+	FORCEINLINE FAffinityTablePage* GetResidentPage(const PageIndex InPage, const TagIndex RowBegin = 0, const TagIndex RowEnd = InvalidIndex) const
+	{
+		EnsurePagesBuilt();
+		if (!Pages.IsValidIndex(InPage))
+		{
+			return nullptr;
+		}
+		if (PageImages.Num() && PageImages[InPage])
+		{
+			// Touch first, so the frame that expands a compressed page does not count as a cache hit too
+			PageImage& Image = *PageImages[InPage];
+			TouchPageImage(Image);
+			if (!Image.bResident.load(std::memory_order_acquire))
+			{
+				LoadPageImage(InPage);
+			}
+			if (Image.PartitionStates.Num() && !ArePartitionsResident(Image, RowBegin, RowEnd))
+			{
+				LoadRowPartitions(InPage, RowBegin, RowEnd, true);
+			}
+		}
+		return &Pages[InPage].Get();
+	}
+
+	/**
+	 * Records an access to a page for ReleaseIdlePages and TrimPageCache. Does nothing for pages without an image.
+	 * @param InPage Page index
+	 */
+	FORCEINLINE void TouchPage(const PageIndex InPage) const
+	{
+		if (PageImages.IsValidIndex(InPage) && PageImages[InPage])
+		{
+			TouchPageImage(*PageImages[InPage]);
+		}
+	}
+
+	/**
+	 * Records an access to a page image. Only writes once per frame, so concurrent readers do not contend on the cache
+	 * line. Page cache hits are counted here too, once per frame an expanded compressed page is reused.
+	 */
+	FORCEINLINE void TouchPageImage(PageImage& Image) const
+	{
+		if (Image.LastAccessFrame.load(std::memory_order_relaxed) != GFrameCounter)
+		{
+			Image.LastAccessFrame.store(GFrameCounter, std::memory_order_relaxed);
+			if (Image.CompressedData.Num() && Image.bResident.load(std::memory_order_relaxed))
+			{
+				PageCacheHits.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	/**
+	 * Finds the row partitions that overlap a range of rows. Returns false if there are none.
+	 * @param RowBegin First row
+	 * @param RowEnd One past the last row, or InvalidIndex for all rows
+	 * @param OutFirst First partition in the range
+	 * @param OutLast Last partition in the range
+	 */
+	FORCEINLINE bool GetPartitionsForRows(const TagIndex RowBegin, const TagIndex RowEnd, int32& OutFirst, int32& OutLast) const
+	{
+		const TagIndex End = FMath::Min(RowEnd, static_cast<TagIndex>(RowPartitionIndexes.Num()));
+		if (RowBegin >= End)
+		{
+			return false;
+		}
+		OutFirst = RowPartitionIndexes[RowBegin];
+		OutLast = RowPartitionIndexes[End - 1];
+		return true;
+	}
+
+	/**
+	 * True if the provided rows of a page are in memory
+	 * @param InPage Page index
+	 * @param RowBegin First row
+	 * @param RowEnd One past the last row, or InvalidIndex for all rows
+	 */
+	bool IsRowResident(PageIndex InPage, TagIndex RowBegin, TagIndex RowEnd) const;
+
+	/** True if all partitions of a page overlapping the provided rows are loaded */
+	FORCEINLINE bool ArePartitionsResident(const PageImage& Image, const TagIndex RowBegin, const TagIndex RowEnd) const
+	{
+		int32 First, Last;
+		if (GetPartitionsForRows(RowBegin, RowEnd, First, Last))
+		{
+			for (int32 i = First; i <= Last; ++i)
+			{
+				if (Image.PartitionStates[i].load(std::memory_order_acquire) != static_cast<uint8>(EPartitionState::Resident))
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Loads the partitions of a page overlapping the provided rows.
+	 * @param InPage Partitioned page
+	 * @param RowBegin First row
+	 * @param RowEnd One past the last row, or InvalidIndex for all rows
+	 * @param Wait If true, return once the partitions are resident. Otherwise only start their loads.
+	 */
+	void LoadRowPartitions(PageIndex InPage, TagIndex RowBegin, TagIndex RowEnd, bool Wait) const;
+
+	/**
+	 * Builds our row partitions from the current rows. See RowPartitionDepth.
+	 */
+	void BuildRowPartitions();
+
+	/**
+	 * Finds the partition of a row tag, or its partition root. Returns INDEX_NONE if there is none.
+	 * @param InRow Row tag
+	 */
+	int32 GetRowPartition(const FGameplayTag& InRow) const;
+
+	/**
+	 * Copies the bulk data image of an on-demand page into its memory, or expands a compressed page. Does nothing if
+	 * it is already resident. Never releases other pages, see TrimPageCache.
+	 * @param InPage Page index
+	 */
+	void LoadPageImage(PageIndex InPage) const;
+
+	/**
+	 * Frees the memory of a resident on-demand or compressed page. Must be called under PageImageLock.
+	 * @param InPage Page index
+	 */
+	void ReleasePageImage(PageIndex InPage) const;
+
+	/**
+	 * Compresses the cells of a dense page into a new image, and releases the page memory.
+	 * Returns nullptr, leaving the page untouched, if compression fails.
+	 * @param InPage Page to compress
+	 */
+	TUniquePtr<PageImage> CompressPage(FAffinityTablePage& InPage) const;
+
+	/**
+	 * Compresses a raw image of a page into a new image. Returns nullptr if compression fails.
+	 * @param InData Start of the raw image
+	 * @param InSize Size of the raw image
+	 * @param InStruct Structure of the page
+	 */
+	TUniquePtr<PageImage> CompressImage(const uint8* InData, int64 InSize, const UScriptStruct* InStruct) const;
+
+	/**
+	 * True if pages of the provided structure and dimensions are kept compressed. See CompressedStructures.
+	 * @param InStruct Structure of the page
+	 * @param InRows Number of rows on the page
+	 * @param InColumns Number of columns on the page
+	 */
+	bool ShouldCompressPage(const UScriptStruct* InStruct, uint32 InRows, uint32 InColumns) const;
+
+	/**
+	 * Cell alignment for new pages of a structure: a cache line if it is in CacheLinePaddedStructures, zero otherwise.
+	 * @param InStruct Structure of the page
+	 */
+	uint32 GetCellAlignment(const UScriptStruct* InStruct) const;
+
+	/**
+	 * Creates a cell range over a page, clamping the provided bounds to the page dimensions.
+	 * Invalid pages and indexes produce empty ranges.
+	 */
+	template <typename T>
+	TAffinityTableCellRange<T> MakeCellRange(const PageIndex InPage, const uint32 RowBegin, const uint32 RowEnd, const uint32 ColumnBegin, const uint32 ColumnEnd) const
+	{
+		if (RowBegin == InvalidIndex || ColumnBegin == InvalidIndex)
+		{
+			return TAffinityTableCellRange<T>();
+		}
+
+		// Only the rows we cover need to be resident. MAX_uint32 ends are InvalidIndex, which means every row.
+		const FAffinityTablePage* Page = GetResidentPage(InPage, RowBegin, RowEnd);
+		if (!Page)
+		{
+			return TAffinityTableCellRange<T>();
+		}
+
+		uint32 RowCount, ColumnCount;
+		Page->GetRowAndColumnCount(RowCount, ColumnCount);
+		RowCount = FMath::Min(RowCount, static_cast<uint32>(RowIndexTags.Num()));
+		ColumnCount = FMath::Min(ColumnCount, static_cast<uint32>(ColumnIndexTags.Num()));
+		return TAffinityTableCellRange<T>(Page, &RowIndexTags, &ColumnIndexTags,
+			RowBegin, FMath::Min(RowEnd, RowCount), ColumnBegin, FMath::Min(ColumnEnd, ColumnCount));
+	}
+
+	/**
+	 * Orders tags depth-first: parents before their children, and each subtree contiguous.
+	 * Used to lay out rows and columns on save.
+	 */
+	static bool HierarchyOrderLess(const FGameplayTag& A, const FGameplayTag& B);
+
+	/**
+	 * Computes subtree ranges for the provided tags, if they are laid out in hierarchy order.
+	 * @param InTags Tags in index order
+	 * @param OutRanges Receives one range per tag. Left empty if the tags are not in hierarchy order
+	 */
+	static void BuildSubtreeRanges(const TArray<FGameplayTag>& InTags, TMap<FGameplayTag, IndexRange>& OutRanges);
+
 	/** Tags available in our table's rows */
 	TMap<FGameplayTag, TagIndex> Rows;
 
 	/** Tags available in our table's columns */
 	TMap<FGameplayTag, TagIndex> Columns;
 
+	/** Closest-match resolution for our rows and columns, by tag net index. See Indexing */
+	struct FResolution
+	{
+		TArray<TagIndex> Rows;
+		TArray<TagIndex> Columns;
+	};
+
+	/**
+	 * Current resolution. Published resolutions are never modified, so queries read them without a lock. Tag tree
+	 * changes publish a new one while queries may still read the old one, which stays alive until the next topology edit.
+	 */
+	std::atomic<const FResolution*> Resolution{ nullptr };
+
+	/** Every resolution we published and did not release yet, the current one last */
+	TArray<TUniquePtr<FResolution>> Resolutions;
+
+	/** Keeps our resolution indexes in sync with the gameplay tag tree */
+	FDelegateHandle TagTreeChangedHandle;
+
+	/** Serializes resolution publishers */
+	mutable FRWLock ResolutionLock;
+
 	/** Colors for rows */
 	TMap<FGameplayTag, FLinearColor> RowColors;
 
@@ -427,6 +1703,73 @@ private:
 	/** Memory pages for our structures. length(Pages) === length(Structures)  */
 	TArray<TSharedRef<FAffinityTablePage>> Pages;
 
+	/** Position of each structure's page in Pages */
+	TMap<const UScriptStruct*, PageIndex> PageIndexes;
+
+	/** Row tags by row index. Deleted rows hold an invalid tag */
+	TArray<FGameplayTag> RowIndexTags;
+
+	/** Column tags by column index. Deleted columns hold an invalid tag */
+	TArray<FGameplayTag> ColumnIndexTags;
+
+	/** Row subtree ranges. Empty unless our rows are in hierarchy order */
+	TMap<FGameplayTag, IndexRange> RowRanges;
+
+	/** Column subtree ranges. Empty unless our columns are in hierarchy order */
+	TMap<FGameplayTag, IndexRange> ColumnRanges;
+
+	/** Built projections, by page index. Null for pages without projections */
+	TArray<TUniquePtr<FAffinityTablePageProjection>> PageProjections;
+
+	/** Memoized query results, if enabled */
+	TUniquePtr<FAffinityTableQueryCache> QueryCache;
+
+	/** Topology version. See GetEpoch */
+	std::atomic<uint32> Epoch{ 0 };
+
+	/** Images of on-demand pages, by page index. Empty if we have none, null for pages that always load */
+	TArray<TUniquePtr<PageImage>> PageImages;
+
+	/** Serializes loading and releasing on-demand pages */
+	mutable FCriticalSection PageImageLock;
+
+	/** Row ranges of our row partitions, by partition index. See RowPartitionDepth */
+	TArray<IndexRange> RowPartitions;
+
+	/** Partition index of every row, by row index */
+	TArray<int32> RowPartitionIndexes;
+
+	/** Partition index by partition root tag */
+	TMap<FGameplayTag, int32> RowPartitionRoots;
+
+	/** Memory used by expanded compressed pages. Guarded by PageImageLock */
+	mutable int64 PageCacheBytes{ 0 };
+
+	/** Compressed page cache statistics. See GetPageCacheStats */
+	mutable std::atomic<uint64> PageCacheHits{ 0 };
+	mutable std::atomic<uint64> PageCacheMisses{ 0 };
+	mutable std::atomic<uint64> PageCacheEvictions{ 0 };
+
+	/** Pages captured by our last load, until BuildPendingPages runs */
+	TArray<PendingPage> PendingPages;
+
+	/** Page build started by PostLoad. See EnsurePagesBuilt */
+	TFuture<void> PageBuild;
+
+	/** True while PageBuild runs */
+	std::atomic<bool> bPagesPending{ false };
+
+	/** Thread running PageBuild. It reads pages through the same accessors as queries, and must not wait on itself */
+	std::atomic<uint32> PageBuildThread{ 0 };
+
+#if WITH_EDITORONLY_DATA
+	/** Serialized cells of our pages, by page index. See MarkCellDirty */
+	TArray<SavedPage> SavedPages;
+
+	/** On-demand page images written by our last cook. Bulk data must outlive the save of its package */
+	TArray<TUniquePtr<FByteBulkData>> CookedPageImages;
+#endif
+
 	/** Inheritance set. Used mostly for the editor */
 	TMap<FName, InheritanceMap> InheritanceMaps;
 
@@ -442,12 +1785,29 @@ private:
 	/** True if we ran into any errors when loading this table */
 	bool bHasLoadingErrors{ false };
 
+#if WITH_EDITORONLY_DATA
+	/** True if RedirectTags renamed any of our tags during load, so this table needs to be saved again */
+	bool bTagsRedirected{ false };
+#endif
+
+	/** Minimum number of cells in a page before searches run in parallel */
+	static constexpr int32 ParallelSearchMinCells = 4096;
+
+	/** Minimum number of cells each worker processes on parallel batch queries */
+	static constexpr int32 BatchQueryChunkSize = 1024;
+
 	/** Data serialization versioning */
 	static const uint32 FileFormatVersion;
 
+	/** Oldest format version LoadTable can upgrade */
+	static const uint32 MinFileFormatVersion;
+
 #if WITH_EDITORONLY_DATA
 	/** Callback for events happening to our structure array */
 	StructureChangeCallback ChangeCallback;
+
+	/** Callback for CompactPages */
+	CellsMovedCallback MovedCallback;
 #endif
 };
 
@@ -467,6 +1827,9 @@ public:
 	UFUNCTION(BlueprintCallable, CustomThunk, Category = "AffinityTable", meta = (BlueprintInternalUseOnly = "true"))
 	static bool QueryTableForRow(UAffinityTable* Table, const FGameplayTag& RowTag, bool ExactMatch, TArray<const UScriptStruct*> StructureTypes, TArray<FCellDataArrayWrapper>& OutMemoryPtrs);
 
+	UFUNCTION(BlueprintCallable, CustomThunk, Category = "AffinityTable", meta = (BlueprintInternalUseOnly = "true"))
+	static bool QueryTableForColumn(UAffinityTable* Table, const FGameplayTag& ColumnTag, bool ExactMatch, TArray<const UScriptStruct*> StructureTypes, TArray<FCellDataArrayWrapper>& OutMemoryPtrs);
+
 	UFUNCTION(BlueprintCallable, CustomThunk, Category = "AffinityTable", meta = (CustomStructureParam = "OutData", BlueprintInternalUseOnly = "true"))
 	static void GetTableCellData(const UScriptStruct* StructType, int32 DataIndex, TArray<FAffinityTableCellDataWrapper> MemoryPtrs, FAffinityTableCellDataWrapper& OutData);
 
@@ -505,6 +1868,21 @@ public:
 		*static_cast<bool*>(RESULT_PARAM) = Table->QueryForRow(RowTag, ExactMatch, StructureTypes, OutMemoryPtrs);
 	}
 
+	// Implements QueryTableForColumn
+	DECLARE_FUNCTION(execQueryTableForColumn)
+	{
+		P_GET_OBJECT(UAffinityTable, Table);
+		P_GET_STRUCT_REF(FGameplayTag, ColumnTag);
+		P_GET_UBOOL(ExactMatch);
+		P_GET_TARRAY(const UScriptStruct*, StructureTypes);
+		P_GET_TARRAY_REF(FCellDataArrayWrapper, OutMemoryPtrs);
+
+		P_FINISH;
+
+		check(Table);
+		*static_cast<bool*>(RESULT_PARAM) = Table->QueryForColumn(ColumnTag, ExactMatch, StructureTypes, OutMemoryPtrs);
+	}
+
 	// Implements GetTableCellDataFromArray
 	DECLARE_FUNCTION(execGetTableCellData)
 	{
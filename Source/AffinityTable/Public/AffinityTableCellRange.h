@@ -0,0 +1,174 @@
+/**
+ * Copyright 2024 Inflexion Games. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "AffinityTablePage.h"
+#include "CoreMinimal.h"
+#include "GameplayTagContainer.h"
+
+/**
+ * A cell visited by a TAffinityTableCellRange
+ */
+template <typename T>
+struct TAffinityTableCellRef
+{
+	/** Row tag of the cell */
+	FGameplayTag Row;
+
+	/** Column tag of the cell */
+	FGameplayTag Column;
+
+	/** Cell data on the iterated page */
+	T* Data;
+};
+
+/**
+ * A zero-copy view over a rectangular set of cells on a single page: a row, a column, or the whole page.
+ *
+ * Cells are visited in row-major order, yielding their tags and data without building arrays. Deleted rows,
+ * deleted columns and invalid handles are skipped. Usable in range-for:
+ *
+ *	for (const TAffinityTableCellRef<const FMyStruct> CellRef : Table->GetRowCells<FMyStruct>(RowTag, true)) { ... }
+ *
+ * Ranges are only valid for as long as the table's topology does not change. See UAffinityTable::GetEpoch.
+ */
+template <typename T>
+class TAffinityTableCellRange
+{
+public:
+	/** An empty range */
+	TAffinityTableCellRange() = default;
+
+	/**
+	 * Creates a new range
+	 * @param InPage Page we iterate. May be null for an empty range
+	 * @param InRowTags Row tags, by row index. Invalid tags mark deleted rows
+	 * @param InColumnTags Column tags, by column index. Invalid tags mark deleted columns
+	 * @param InRowBegin First row to iterate
+	 * @param InRowEnd One past the last row to iterate
+	 * @param InColumnBegin First column to iterate
+	 * @param InColumnEnd One past the last column to iterate
+	 */
+	TAffinityTableCellRange(const FAffinityTablePage* InPage, const TArray<FGameplayTag>* InRowTags, const TArray<FGameplayTag>* InColumnTags,
+		uint32 InRowBegin, uint32 InRowEnd, uint32 InColumnBegin, uint32 InColumnEnd)
+		: Page(InPage)
+		, RowTags(InRowTags)
+		, ColumnTags(InColumnTags)
+		, RowBegin(InRowBegin)
+		, RowEnd(InRowEnd)
+		, ColumnBegin(InColumnBegin)
+		, ColumnEnd(InColumnEnd)
+	{
+		// Normalize empty ranges so begin() == end()
+		if (!Page || RowBegin >= RowEnd || ColumnBegin >= ColumnEnd)
+		{
+			RowBegin = RowEnd = ColumnBegin = ColumnEnd = 0;
+		}
+	}
+
+	/** Forward iterator over the valid cells of a range */
+	class FIterator
+	{
+	public:
+		FIterator(const TAffinityTableCellRange& InRange, uint32 InRow, uint32 InColumn)
+			: Range(InRange)
+			, Row(InRow)
+			, Column(InColumn)
+			, Data(nullptr)
+		{
+			SkipInvalid();
+		}
+
+		FORCEINLINE FIterator& operator++()
+		{
+			Step();
+			SkipInvalid();
+			return *this;
+		}
+
+		FORCEINLINE TAffinityTableCellRef<T> operator*() const
+		{
+			return TAffinityTableCellRef<T>{ (*Range.RowTags)[Row], (*Range.ColumnTags)[Column], Data };
+		}
+
+		FORCEINLINE bool operator!=(const FIterator& Other) const
+		{
+			return Row != Other.Row || Column != Other.Column;
+		}
+
+	private:
+		/** Moves to the next cell, valid or not */
+		FORCEINLINE void Step()
+		{
+			if (++Column >= Range.ColumnEnd)
+			{
+				Column = Range.ColumnBegin;
+				++Row;
+			}
+		}
+
+		/** Moves forward until we sit on a valid cell or the end of the range */
+		void SkipInvalid()
+		{
+			while (Row < Range.RowEnd)
+			{
+				// Skip whole deleted rows
+				if (!(*Range.RowTags)[Row].IsValid())
+				{
+					Column = Range.ColumnBegin;
+					++Row;
+					continue;
+				}
+
+				if ((*Range.ColumnTags)[Column].IsValid())
+				{
+					Data = reinterpret_cast<T*>(Range.Page->GetDatablockPtr(Row, Column));
+					if (Data)
+					{
+						return;
+					}
+				}
+				Step();
+			}
+			Column = Range.ColumnBegin;
+		}
+
+		const TAffinityTableCellRange& Range;
+		uint32 Row;
+		uint32 Column;
+		T* Data;
+	};
+
+	FORCEINLINE FIterator begin() const
+	{
+		return FIterator(*this, RowBegin, ColumnBegin);
+	}
+
+	FORCEINLINE FIterator end() const
+	{
+		return FIterator(*this, RowEnd, ColumnBegin);
+	}
+
+private:
+	const FAffinityTablePage* Page{ nullptr };
+	const TArray<FGameplayTag>* RowTags{ nullptr };
+	const TArray<FGameplayTag>* ColumnTags{ nullptr };
+	uint32 RowBegin{ 0 };
+	uint32 RowEnd{ 0 };
+	uint32 ColumnBegin{ 0 };
+	uint32 ColumnEnd{ 0 };
+};
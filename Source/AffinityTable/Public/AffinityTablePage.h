@@ -33,7 +33,33 @@
  * recycle/garbage collect if it can.
  *
  * You can mix these modes by providing an initial size and activating dynamic mode: the memory will
- *  be allocated, and subsequent blocks of FStructDatablock::MaxDatablockCapacity will be added as required.
+ *  be allocated, and subsequent datablocks will be added as required. Datablock capacity is picked per structure
+ *  on construction, see FStructDatablock::ComputeCapacity.
+ *
+ * Deleting rows and columns leaves recycled handles scattered across datablocks. Compact repacks the cells
+ * in row-major order and frees the datablocks that are no longer needed.
+ *
+ * Dense layout
+ *
+ * Fixed mode pages with a nonzero size use a dense layout: a single datablock of Rows x Columns structures,
+ * addressed as Row * Columns + Column. There are no handles and no per-row objects, so cell access is pointer
+ * arithmetic and row scans are sequential reads. Dense pages cannot change size.
+ *
+ * Dense pages can release their cell memory and allocate it again later, keeping their dimensions (see
+ * ReleaseDenseMemory). Cells of a page that is not resident must not be accessed. Dense pages can also use
+ * external memory they do not own, like a read-only mapping of cooked data (see UseExternalMemory), or reserved
+ * address space where rows are committed as needed (see ReserveDenseMemory).
+ *
+ * Cell alignment
+ *
+ * Cells are always aligned for their structure. Pages can also pad every cell to start on a larger boundary, such as a
+ * cache line, so threads writing to neighbouring cells do not contend for the same line. Padded dense pages only use
+ * memory they allocate: external, adopted and reserved memory hold packed raw images.
+ *
+ * Plain structures
+ *
+ * Pages read the flags of their structure once, on construction. Structures that allow it are initialized, copied,
+ * compared and destroyed with plain memory operations instead of reflection (see FStructDatablock::StructTraits).
  *
  */
 class FAffinityTablePage
@@ -48,6 +74,25 @@ public:
 	/** A row in our page is an ordered array of in-memory structures */
 	using Row = TArray<DataHandle>;
 
+	/** Memory usage of a page. See GetMemoryStats */
+	struct MemoryStats
+	{
+		/** Number of datablocks */
+		int32 Datablocks{ 0 };
+
+		/** Datablocks allocated straight from the OS */
+		int32 OSDatablocks{ 0 };
+
+		/** Cells per datablock. Dense pages have a single datablock for all their cells */
+		uint32 DatablockCapacity{ 0 };
+
+		/** Memory allocated by our datablocks, in bytes */
+		SIZE_T AllocatedBytes{ 0 };
+
+		/** Memory taken by live cells, in bytes. The rest of AllocatedBytes is padding and unused cells */
+		SIZE_T CellBytes{ 0 };
+	};
+
 	/**
 	 * Creates a new instance.
 	 * @param InStruct The UScriptStruct used to format our page's memory
@@ -55,8 +100,13 @@ public:
 	 * @param InColumns Number of columns to allocate per row.
 	 * @param InFixedMode If true and InBlocks * InColumns is nonzero, allocation happens immediately and it remains static
 	 *	for the lifetime of the instance.
+	 * @param InInitialize If false, dense pages leave their memory uninitialized. The caller must fill it right away,
+	 *	see LoadRawImage.
+	 * @param InCellAlignment If nonzero, every cell starts on a multiple of this power of two. See Cell alignment.
+	 * @param InAllocate If false, dense pages start released, as if by ReleaseDenseMemory.
 	 */
-	FAffinityTablePage(const UScriptStruct* InStruct, uint32 InRows = 0, uint32 InColumns = 0, bool InFixedMode = false);
+	FAffinityTablePage(const UScriptStruct* InStruct, uint32 InRows = 0, uint32 InColumns = 0, bool InFixedMode = false, bool InInitialize = true,
+		uint32 InCellAlignment = 0, bool InAllocate = true);
 
 	/** Clean-up */
 	~FAffinityTablePage();
@@ -83,6 +133,14 @@ public:
 	 */
 	void DeleteColumn(uint32 ColumnIndex);
 
+	/**
+	 * Moves our cells to new datablocks in row-major order, using as few datablocks as possible, and frees the old ones.
+	 * Row and column indexes do not change, but every pointer to our cells becomes invalid. Does nothing on dense pages,
+	 * or if our cells are already packed.
+	 * @return True if any cell moved
+	 */
+	bool Compact();
+
 	/**
 	 * Const access to this page's structure
 	 */
@@ -97,19 +155,51 @@ public:
 	 */
 	FORCEINLINE void GetRowAndColumnCount(uint32& OutRows, uint32& OutColumns) const
 	{
-		OutRows = static_cast<uint32>(Rows.Num());
+		OutRows = IsDense() ? DenseRows : static_cast<uint32>(Rows.Num());
 		OutColumns = Columns;
 	}
 
+	/**
+	 * True if this page uses the dense, handle-less layout. See Dense layout.
+	 */
+	FORCEINLINE bool IsDense() const
+	{
+		return DenseRows != 0;
+	}
+
+	/**
+	 * True if our cells are in memory. Only dense pages can be released, see ReleaseDenseMemory.
+	 */
+	FORCEINLINE bool IsResident() const
+	{
+		return !IsDense() || DenseData != nullptr;
+	}
+
+	/**
+	 * True if our cells live in external memory, see UseExternalMemory. Such cells are read-only.
+	 */
+	FORCEINLINE bool UsesExternalMemory() const
+	{
+		return bExternalMemory;
+	}
+
 	/**
 	 * Retrieve the data associated with the provided cell position.
 	 * @param InRow Row index
 	 * @param InColumn index
 	 */
-	FStructDatablock::DatablockPtr GetDatablockPtr(uint32 InRow, uint32 InColumn) const;
+	FORCEINLINE FStructDatablock::DatablockPtr GetDatablockPtr(uint32 InRow, uint32 InColumn) const
+	{
+		if (IsDense())
+		{
+			check(InRow < DenseRows && InColumn < Columns);
+			return DenseData + (static_cast<SIZE_T>(InRow) * Columns + InColumn) * DenseCellStride;
+		}
+		return GetHandleDatablockPtr(InRow, InColumn);
+	}
 
 	/**
-	 * Retrieve the data associated with the provided handle
+	 * Retrieve the data associated with the provided handle. Not available on dense pages.
 	 * @param Handle A handle to the requested data
 	 */
 	FStructDatablock::DatablockPtr GetDatablockPtr(DataHandle Handle) const;
@@ -121,18 +211,132 @@ public:
 	 */
 	void GetDatablockPtrsForRow(uint32 InRow, TArray<FStructDatablock::DatablockPtr>& OutDataBlocks) const;
 
+	/**
+	 * Retrieve the data associated with the provided column
+	 * @param InColumn Column index
+	 * @param OutDataBlocks List of datablock pointers for the whole column
+	 */
+	void GetDatablockPtrsForColumn(uint32 InColumn, TArray<FStructDatablock::DatablockPtr>& OutDataBlocks) const;
+
 	/**
 	 * Provide the size footprint of our assigned structure
 	 */
 	int32 GetStructSize() const;
 
+	/**
+	 * Distance between neighbouring cells in memory: the cells of a dense row, or of a datablock. Larger than
+	 * GetStructSize if cells are padded, see Cell alignment.
+	 */
+	int32 GetCellStride() const;
+
+	/**
+	 * Copies a cell of this page over another, with a plain memory copy if our structure allows it.
+	 * @param Dest Cell to overwrite
+	 * @param Source Cell to copy
+	 */
+	void CopyCell(FStructDatablock::DatablockPtr Dest, const uint8* Source) const;
+
+	/**
+	 * Deep compares two cells of this page. Bitwise equal plain structures are identical without a reflected compare.
+	 * @param CellA First cell to compare
+	 * @param CellB Second cell to compare
+	 */
+	bool AreCellsIdentical(const uint8* CellA, const uint8* CellB) const;
+
+	/**
+	 * Retrieves the memory usage of this page. External memory (see UseExternalMemory) is not counted.
+	 * @param OutStats Receives our memory usage
+	 */
+	void GetMemoryStats(MemoryStats& OutStats) const;
+
+	/**
+	 * Frees the cell memory of a dense page. Our dimensions are kept, and the memory can be restored with AllocateDenseMemory.
+	 */
+	void ReleaseDenseMemory();
+
+	/**
+	 * Allocates the cell memory of a dense page released with ReleaseDenseMemory.
+	 * @param InInitialize If false, memory is left uninitialized. The caller must fill it right away, see LoadRawImage.
+	 */
+	void AllocateDenseMemory(bool InInitialize = true);
+
+	/**
+	 * Points a released dense page at memory we do not own, such as a read-only file mapping. The memory must hold a
+	 * raw image of the page (see SaveRawImage) and outlive the page, or the next call to ReleaseDenseMemory.
+	 * Cells in read-only memory must not be written: pointers to them are still mutable, and writes fault.
+	 * Images we cannot address in place, because they are not aligned for our structure or our cells are padded,
+	 * are copied into memory of our own instead.
+	 * @param InMemory Start of the page image
+	 * @return True if the page points into the provided memory, false if it copied it
+	 */
+	bool UseExternalMemory(FStructDatablock::DatablockPtr InMemory);
+
+	/**
+	 * Hands memory over to a released dense page, which frees it like its own. The memory must be allocated with
+	 * FMemory::Malloc and hold a raw image of the page (see SaveRawImage).
+	 * @param InMemory Start of the page image
+	 */
+	void AdoptDenseMemory(FStructDatablock::DatablockPtr InMemory);
+
+	/**
+	 * Reserves address space for a released dense page without committing any memory. Rows must be committed with
+	 * CommitDenseRows before use. Only valid for structures that support raw images, as rows are never initialized.
+	 */
+	void ReserveDenseMemory();
+
+	/**
+	 * Commits the memory of a range of rows of a reserved page. Committed memory is zeroed.
+	 * @param RowBegin First row
+	 * @param RowEnd One past the last row
+	 */
+	void CommitDenseRows(uint32 RowBegin, uint32 RowEnd);
+
+	/**
+	 * Returns the memory of a range of rows of a reserved page to the OS. Memory shared with neighbouring rows stays
+	 * committed.
+	 * @param RowBegin First row
+	 * @param RowEnd One past the last row
+	 */
+	void DecommitDenseRows(uint32 RowBegin, uint32 RowEnd);
+
+	/**
+	 * Fills a dense page with a raw image of its cells, as written by SaveRawImage. Returns false and reads nothing
+	 * if the image does not match our dimensions.
+	 * @param Ar Archive to read from
+	 * @param ImageSize Size of the image in the archive
+	 */
+	bool LoadRawImage(FArchive& Ar, int64 ImageSize);
+
+	/**
+	 * Writes the provided cells as a raw image, in the provided order.
+	 * @param Ar Archive to write to
+	 * @param InRows Rows to write
+	 * @param InColumns Columns to write, for every row
+	 * @return Size of the written image
+	 */
+	int64 SaveRawImage(FArchive& Ar, const TArray<uint32>& InRows, const TArray<uint32>& InColumns) const;
+
+	/**
+	 * True if structures of this type can be saved and loaded as raw memory: every property is plain data
+	 * (numbers, bools, enums, or nested structures of those) and there is no native serializer or hidden native state.
+	 * @param InStruct Structure to inspect
+	 */
+	static bool SupportsRawImage(const UScriptStruct* InStruct);
+
+	/**
+	 * Computes a hash of the memory layout of a structure: its size, and the name, type, offset and size of every property.
+	 * Raw images are only valid between identical layouts.
+	 * @param InStruct Structure to hash
+	 */
+	static uint32 ComputeLayoutHash(const UScriptStruct* InStruct);
+
 private:
 	/**
 	 * Allocates enough datablocks to satisfy the provided capacity. Memory is immediately committed.
 	 * If FixedMode, we allocate EXACTLY the required size.
-	 * @param Capacity block capacity in dynamic mode, exact capacity in fixed mode
+	 * @param Capacity Number of cells to allocate, in blocks of DatablockCapacity. Zero allocates a single block.
 	 */
-	void AllocateBlocks(uint32 Capacity = FStructDatablock::MaxDatablockCapacity);
+	void AllocateBlocks(uint32 Capacity = 0);
 
 	/**
 	 * Adds a number of new handles to the end of the provided array. If the count is zero, we add one handle per
@@ -153,6 +357,13 @@ private:
 		return Rows[RowIndex].IsValid() ? Rows[RowIndex].Get() : nullptr;
 	}
 
+	/**
+	 * Retrieve the data associated with the provided cell position on a handle-based page.
+	 * @param InRow Row index
+	 * @param InColumn index
+	 */
+	FStructDatablock::DatablockPtr GetHandleDatablockPtr(uint32 InRow, uint32 InColumn) const;
+
 	/**
 	 * Creates a datahandle with the provided datblock and datablock index
 	 * @param DatablockIndex Index to the datablock in our array
@@ -176,10 +387,16 @@ private:
 	DataHandle NewHandle();
 
 	/**
-	 * Finds an available handle within our memory blocks. Picks new active blocks as necessary.
+	 * Finds an available handle within our memory blocks, taking it from the block on top of the FreeDatablocks stack.
 	 */
 	DataHandle FindAvailableHandle();
 
+	/**
+	 * Returns a handle to its datablock, and makes the datablock available to FindAvailableHandle again.
+	 * @param Handle Valid handle to recycle
+	 */
+	void RecycleHandle(DataHandle Handle);
+
 	/** Struct for this page */
 	TWeakObjectPtr<const UScriptStruct> Struct;
 
@@ -189,8 +406,11 @@ private:
 	/** Data blocks managed by this page */
 	TArray<FStructDatablock*> Datablocks;
 
-	/** Set of columns that are no longer usable */
-	TSet<uint32> DeletedColumns;
+	/** Columns that are no longer usable, by column index */
+	TBitArray<> DeletedColumns;
+
+	/** Number of set bits in DeletedColumns */
+	uint32 DeletedColumnCount;
 
 	/** Number of columns per row */
 	uint32 Columns;
@@ -198,6 +418,36 @@ private:
 	/** True if we are running in fixed memory mode */
 	bool FixedMode;
 
-	/** Reference to our working datablock */
-	uint32 CurrentDatablock;
+	/** Stack of the datablocks that may have free handles. The top one hands out handles until it is full */
+	TArray<uint32> FreeDatablocks;
+
+	/** Datablocks in FreeDatablocks, by datablock index */
+	TBitArray<> FreeDatablockFlags;
+
+	/** Start of our single datablock if we use the dense layout and are resident, nullptr otherwise */
+	FStructDatablock::DatablockPtr DenseData;
+
+	/** Number of rows in our dense layout, zero if we use handles */
+	uint32 DenseRows;
+
+	/** Cached struct size for dense pages */
+	SIZE_T DenseStructSize;
+
+	/** Cached cell stride for dense addressing, see GetCellStride */
+	SIZE_T DenseCellStride;
+
+	/** Requested cell alignment, zero for packed cells */
+	uint32 CellAlignment;
+
+	/** Cells per datablock on handle-based pages, see FStructDatablock::ComputeCapacity */
+	uint32 DatablockCapacity;
+
+	/** Shortcuts allowed by our structure, see Plain structures */
+	FStructDatablock::StructTraits Traits;
+
+	/** Address space of a reserved dense page, see ReserveDenseMemory */
+	FPlatformMemory::FPlatformVirtualMemoryBlock ReservedMemory;
+
+	/** True if DenseData points to memory we do not own, see UseExternalMemory */
+	bool bExternalMemory;
 };
@@ -0,0 +1,83 @@
+/**
+ * Copyright 2024 Inflexion Games. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Class.h"
+
+class FAffinityTablePage;
+
+/**
+ * A structure-of-arrays projection of numeric properties from a single page.
+ *
+ * Pages store whole structures back to back, so scanning one field strides by the structure size. A projection
+ * copies chosen numeric properties into contiguous, cache-line aligned float arrays in row-major order
+ * (Row * Columns + Column), ready for vectorized scans.
+ *
+ * Projections are snapshots: our owning table rebuilds them whenever its topology changes. Code that writes
+ * cell data directly must call UAffinityTable::RefreshProjections for the change to be visible here.
+ * Cells without data (deleted rows or columns) project as zero.
+ */
+class AFFINITYTABLE_API FAffinityTablePageProjection
+{
+public:
+	/** Alignment of our value arrays */
+	static constexpr uint32 ValueAlignment = 64;
+
+	/** Contiguous values of a single property */
+	using ValueArray = TArray<float, TAlignedHeapAllocator<ValueAlignment>>;
+
+	/**
+	 * Extracts the provided properties out of the page. Non-numeric or unknown properties are skipped with a warning.
+	 * @param Page Page to project
+	 * @param PropertyNames Top-level numeric properties of the page's structure
+	 */
+	void Build(const FAffinityTablePage& Page, const TArray<FName>& PropertyNames);
+
+	/**
+	 * Provides all values of a property, in row-major order. Empty if we did not project it.
+	 * @param PropertyName Name of a projected property
+	 */
+	TConstArrayView<float> GetValues(FName PropertyName) const;
+
+	/**
+	 * Provides the values of a property for a single row. Empty if we did not project it.
+	 * @param PropertyName Name of a projected property
+	 * @param Row Row index
+	 */
+	TConstArrayView<float> GetRowValues(FName PropertyName, uint32 Row) const;
+
+	/** Number of rows projected */
+	FORCEINLINE uint32 GetRowCount() const
+	{
+		return Rows;
+	}
+
+	/** Number of columns projected */
+	FORCEINLINE uint32 GetColumnCount() const
+	{
+		return Columns;
+	}
+
+private:
+	/** Projected values, per property */
+	TMap<FName, ValueArray> Values;
+
+	/** Page dimensions at the time of projection */
+	uint32 Rows{ 0 };
+	uint32 Columns{ 0 };
+};
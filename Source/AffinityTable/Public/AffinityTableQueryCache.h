@@ -0,0 +1,114 @@
+/**
+ * Copyright 2024 Inflexion Games. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeRWLock.h"
+
+/**
+ * Memoizes the result of affinity table queries.
+ *
+ * Entries are keyed by a packed pair of tag net indexes (see MakeKey) and hold the resolved cell plus
+ * the data location of that cell on every page of the table. Any number of threads may read and fill
+ * the cache concurrently.
+ *
+ * The cache is tied to a table epoch. Our owner increments its epoch whenever its topology changes
+ * (rows, columns, pages, reloads) or net indexes are re-assigned; entries recorded under another epoch
+ * are never returned, and are discarded on the first write under a newer epoch. Epochs are compared with
+ * serial number arithmetic, so they may wrap around.
+ */
+class AFFINITYTABLE_API FAffinityTableQueryCache
+{
+public:
+	/** A memoized query result */
+	struct FEntry
+	{
+		/** Resolved row index */
+		uint32 Row;
+
+		/** Resolved column index */
+		uint32 Column;
+
+		/** Data location of the cell on each page, in page order */
+		TArray<uint8*, TInlineAllocator<16>> PageData;
+	};
+
+	/**
+	 * Packs a pair of tag net indexes and the match type into a cache key. Tags without a net index (unknown to the
+	 * tags manager) must not be memoized, as they would all share a key.
+	 * @param RowTagId Net index of the queried row tag
+	 * @param ColumnTagId Net index of the queried column tag
+	 * @param ExactMatch Match type for the query
+	 */
+	static FORCEINLINE uint64 MakeKey(uint32 RowTagId, uint32 ColumnTagId, bool ExactMatch)
+	{
+		return (static_cast<uint64>(RowTagId) << 32) | (static_cast<uint64>(ColumnTagId) << 1) | (ExactMatch ? 1 : 0);
+	}
+
+	/**
+	 * Looks up a memoized entry and, if found, hands it to the provided function while our read lock is held. Counts
+	 * as a hit or a miss.
+	 * @param Key Key built by MakeKey
+	 * @param Epoch Current epoch of the table
+	 * @param OnFound Reads the entry. Must not take our lock again, or query the table.
+	 * @return True if we had an entry for this key and epoch
+	 */
+	bool Find(uint64 Key, uint32 Epoch, TFunctionRef<void(const FEntry&)> OnFound) const;
+
+	/**
+	 * Memoizes a query result. Flushes the cache first if the epoch advanced, and drops the result if it was resolved
+	 * under an older epoch than our entries.
+	 * @param Key Key built by MakeKey
+	 * @param Epoch Epoch of the table when the entry was resolved
+	 * @param Entry Result to store
+	 */
+	void Add(uint64 Key, uint32 Epoch, FEntry&& Entry);
+
+	/** Removes all entries and resets our statistics */
+	void Reset();
+
+	/** Number of queries answered from the cache */
+	FORCEINLINE uint64 GetHits() const
+	{
+		return Hits.load(std::memory_order_relaxed);
+	}
+
+	/** Number of queries that had to be resolved */
+	FORCEINLINE uint64 GetMisses() const
+	{
+		return Misses.load(std::memory_order_relaxed);
+	}
+
+	/** Number of entries currently stored */
+	int32 Num() const;
+
+private:
+	/** Guards Entries and CacheEpoch */
+	mutable FRWLock Lock;
+
+	/** Memoized results */
+	TMap<uint64, FEntry> Entries;
+
+	/** Table epoch for all of our entries */
+	uint32 CacheEpoch{ 0 };
+
+	/** Statistics */
+	mutable std::atomic<uint64> Hits{ 0 };
+	mutable std::atomic<uint64> Misses{ 0 };
+};
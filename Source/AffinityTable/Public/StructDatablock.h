@@ -28,13 +28,19 @@
  *
  * 1 block = 1 structure. Therefore the size of this datablock = block capacity * size(structure type)
  *
+ * Owners pick a capacity that brings datablocks close to a target size in bytes (see ComputeCapacity), so small
+ * structures do not need many tiny allocations and large ones do not waste much on a partly filled block. Datablocks
+ * above a size threshold are allocated straight from the OS, and start zeroed.
+ *
+ * Memory is aligned to the minimum alignment of the structure. Owners can request a larger cell alignment, in which
+ * case every structure is padded to start on a multiple of it (see GetCellStride).
+ *
+ * Structures whose flags allow it are constructed, cleared and destroyed with plain memory operations, see StructTraits.
+ *
  */
 class FStructDatablock
 {
 public:
-	/** Maximum number of block allocations per instance */
-	static const uint32 MaxDatablockCapacity = 512;
-
 	/** Invalid handle designation */
 	static const uint32 InvalidHandle = MAX_uint32;
 
@@ -50,12 +56,28 @@ public:
 	/** Defines a public pointer to a single structured block in our allocated space */
 	using DatablockPtr = DatablockPtrType;
 
+	/** Shortcuts allowed by the flags of a native structure. See GetStructTraits */
+	struct StructTraits
+	{
+		/** Default structures are all zeroes: initialize with memset */
+		bool bZeroConstructor{ false };
+
+		/** Structures are plain data: copy with memcpy, and bitwise equal structures are identical */
+		bool bPlainOldData{ false };
+
+		/** Structures need no destruction */
+		bool bNoDestructor{ false };
+	};
+
 	/**
 	 * @param InStruct Structure used to manage the data in our allocated block
-	 * @param DesiredCapacity Number of allocations to reserve on this block. Will cap at MaxDatablockCapacity.
+	 * @param DesiredCapacity Number of allocations to reserve on this block. See ComputeCapacity.
 	 * @param AllocNow If true, allocate right away. Otherwise alloc on first handle request.
+	 * @param InitializeNow If false and AllocNow is true, memory is left uninitialized. The owner must fill it with valid
+	 *	structures before use, which is only safe for raw-serializable structures (see FAffinityTablePage::SupportsRawImage)
+	 * @param InCellAlignment If nonzero, every structure starts on a multiple of this power of two. Zero packs structures.
 	 */
-	FStructDatablock(const UScriptStruct* InStruct, const uint32 DesiredCapacity, bool AllocNow = false);
+	FStructDatablock(const UScriptStruct* InStruct, const uint32 DesiredCapacity, bool AllocNow = false, bool InitializeNow = true, uint32 InCellAlignment = 0);
 
 	/** Destroys this instance. Will deallocate all of our memory */
 	~FStructDatablock();
@@ -72,6 +94,14 @@ public:
 	 */
 	void RecycleHandle(DatablockHandle Handle);
 
+	/**
+	 * True if NewHandle would succeed: our block is not allocated yet, or has unopened or recycled handles
+	 */
+	FORCEINLINE bool HasFreeHandles() const
+	{
+		return Datablock == nullptr || NextHandle < Capacity || FreeHandles.Num() > 0;
+	}
+
 	/**
 	 * Returns the memory location for a structure given its handle.
 	 * @param Handle Valid memory location handle for this block.
@@ -79,7 +109,7 @@ public:
 	FORCEINLINE DatablockPtr GetMemoryBlock(DatablockHandle Handle) const
 	{
 		check(Handle != InvalidHandle);
-		return Datablock + static_cast<SIZE_T>(Handle) * StructSize;
+		return Datablock + static_cast<SIZE_T>(Handle) * CellStride;
 	}
 
 	/**
@@ -90,23 +120,97 @@ public:
 		return static_cast<int32>(StructSize);
 	}
 
+	/**
+	 * Returns the distance between neighbouring structures in our block. Larger than GetStructSize if cells are padded.
+	 */
+	FORCEINLINE int32 GetCellStride() const
+	{
+		return static_cast<int32>(CellStride);
+	}
+
+	/**
+	 * Returns the number of structures our block holds
+	 */
+	FORCEINLINE uint32 GetCapacity() const
+	{
+		return Capacity;
+	}
+
+	/**
+	 * Returns the size of our allocated memory, or zero if we are not allocated
+	 */
+	FORCEINLINE SIZE_T GetAllocatedSize() const
+	{
+		return Datablock ? CellStride * Capacity : 0;
+	}
+
+	/**
+	 * True if our memory was allocated straight from the OS. See AffinityTable.DatablockOSAllocKB
+	 */
+	FORCEINLINE bool IsAllocatedFromOS() const
+	{
+		return bAllocatedFromOS;
+	}
+
+	/**
+	 * Reads the shortcuts a structure allows from its flags. User defined structures allow none, as they initialize
+	 * from a default instance.
+	 * @param InStruct Linked structure to inspect
+	 */
+	static StructTraits GetStructTraits(const UScriptStruct* InStruct);
+
+	/**
+	 * Computes the capacity of datablocks for a structure: as many cells as fit in AffinityTable.DatablockTargetKB,
+	 * and at least one.
+	 * @param InStruct Structure held by the blocks
+	 * @param InCellAlignment Requested cell alignment, or zero
+	 */
+	static uint32 ComputeCapacity(const UScriptStruct* InStruct, uint32 InCellAlignment);
+
+	/**
+	 * Computes the alignment of a block of structures: the minimum alignment of the structure, or the requested one if larger.
+	 * @param InStruct Structure held by the block
+	 * @param InCellAlignment Requested cell alignment, or zero
+	 */
+	static uint32 ComputeAlignment(const UScriptStruct* InStruct, uint32 InCellAlignment);
+
+	/**
+	 * Computes the distance between neighbouring structures in a block: the structure size, rounded up to the alignment.
+	 * @param InStruct Structure held by the block
+	 * @param InCellAlignment Requested cell alignment, or zero
+	 */
+	static SIZE_T ComputeCellStride(const UScriptStruct* InStruct, uint32 InCellAlignment);
+
 	/**
 	 * De-allocates our block if: (1) free handles = capacity, or (2) no handles have been committed.
 	 */
 	void GarbageCollect();
 
+	/**
+	 * Takes ownership of memory allocated elsewhere, instead of allocating our own block. Only valid for packed cells.
+	 * @param InMemory Memory allocated with FMemory::Malloc and aligned for our structure, holding our full capacity of valid structures
+	 */
+	void Adopt(DatablockPtrType InMemory);
+
 private:
 	/**
 	 * Allocates our datablock. We can re-allocate if necessary, but a manual deletion has to happen first.
 	 * This call allocates the full capacity of the datablock.
+	 * @param Initialize If true, construct every structure in the block
 	 */
-	void Alloc();
+	void Alloc(bool Initialize = true);
 
 	/**
 	 * Deallocates our full datablock. All handles to our memory will be invalid.
 	 */
 	void Dealloc();
 
+	/**
+	 * Constructs or destroys every structure in our block, one cell at a time if they are padded
+	 * @param Initialize If true, construct structures. Otherwise destroy them.
+	 */
+	void InitializeOrDestroyCells(bool Initialize);
+
 	/** Struct used to manage our allocations. Assumed to be valid for the lifetime of this class */
 	TWeakObjectPtr<const UScriptStruct> Struct;
 
@@ -119,12 +223,24 @@ private:
 	/** Cached struct size */
 	SIZE_T StructSize;
 
+	/** Requested cell alignment, zero for packed cells */
+	uint32 CellAlignment;
+
+	/** Cached distance between structures, see ComputeCellStride */
+	SIZE_T CellStride;
+
+	/** True if Datablock came from FPlatformMemory::BinnedAllocFromOS, and must go back to it */
+	bool bAllocatedFromOS;
+
+	/** Cached shortcuts of our structure, see GetStructTraits */
+	StructTraits Traits;
+
 	/** Handle to the next available, unstructured datablock */
 	DatablockHandle NextHandle;
 
 	/** Cached struct name. See Dealloc() */
 	FName StructName;
 
-	/** Array of structured, recycled handles */
+	/** Stack of structured, recycled handles. The most recently recycled handle is reused first */
 	TArray<DatablockHandle> FreeHandles;
 };
@@ -114,7 +114,7 @@ void SAffinityTableCell::UpdateDescription(const FAffinityTableEditor::PageView*
 	TSharedPtr<FAffinityTableEditor::Cell> CellPtr = Cell.Pin();
 
 	FString Desc;
-	uint8* CellData = Editor.Pin()->GetTableBeingEdited()->GetCellData(CellPtr->TableCell, View->PageStruct);
+	const uint8* CellData = Editor.Pin()->GetTableBeingEdited()->GetCellData(CellPtr->TableCell, View->PageStruct);
 	if (CellData && View->VisibleProperties.Num())
 	{
 		FString FullDesc;
@@ -26,6 +26,7 @@
 #include "Framework/Commands/GenericCommands.h"
 #include "Framework/MultiBox/MultiBoxBuilder.h"
 #include "GameplayTagsManager.h"
+#include "HAL/IConsoleManager.h"
 #include "IDetailsView.h"
 #include "IStructureDetailsView.h"
 #include "Misc/MessageDialog.h"
@@ -73,6 +74,12 @@ const FString PreferenceSectionName(TEXT("AffinityTableEditor"));
 
 }
 
+static float GAffinityTableCompactIdleSeconds = 30.0f;
+static FAutoConsoleVariableRef CVarAffinityTableCompactIdleSeconds(
+	TEXT("AffinityTable.CompactIdleSeconds"),
+	GAffinityTableCompactIdleSeconds,
+	TEXT("Seconds without edits before an open affinity table editor compacts the memory of its table. Zero disables idle compaction."));
+
 // Tag Node Walkers
 //////////////////////////////////////////////////////////////////////////////////////
 
@@ -349,6 +356,9 @@ FAffinityTableEditor::FAffinityTableEditor()
 	: TableBeingEdited(nullptr)
 	, CellSelectionType(ECellSelectionType::Single)
 	, SelectedTagIsRow(false)
+	, LastEditTime(0.0)
+	, LastSeenEpoch(0)
+	, bCompactionPending(false)
 {
 	GEditor->RegisterForUndo(this);
 
@@ -364,6 +374,12 @@ FAffinityTableEditor::~FAffinityTableEditor()
 	check(EditorPreferences);
 	EditorPreferences->SaveConfig();
 
+	FTSTicker::GetCoreTicker().RemoveTicker(CompactionTicker);
+	if (TableBeingEdited)
+	{
+		TableBeingEdited->SetCellsMovedCallback(nullptr);
+	}
+
 	GEditor->UnregisterForUndo(this);
 }
 
@@ -496,6 +512,13 @@ void FAffinityTableEditor::InitAffinityTableEditor(const EToolkitMode::Type Mode
 
 	// Register asset callback hooks
 	TableBeingEdited->SetStructureChangeCallback([this](uint32 ChangeType) { this->UpdatePageSet(); });
+
+	// Compaction moves cells, so the details view needs the new location of the selected one
+	TableBeingEdited->SetCellsMovedCallback([this]() { this->DisplaySelectedCellStruct(); });
+	LastSeenEpoch = TableBeingEdited->GetEpoch();
+	LastEditTime = FPlatformTime::Seconds();
+	CompactionTicker = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FAffinityTableEditor::TickIdleCompaction), 1.0f);
+
 	// Create the layout of our custom asset editor
 	const TSharedRef<FTabManager::FLayout> StandaloneDefaultLayout = FTabManager::NewLayout("Standalone_AffinityTableEditor_Layout_v1")
 																		 ->AddArea(
@@ -1154,7 +1177,8 @@ void FAffinityTableEditor::DisplaySelectedCellStruct()
 		{
 			const UScriptStruct* PageStruct = ActivePageView->PageStruct;
 
-			uint8* StructData = TableBeingEdited->GetCellData(CellPtr.Pin()->TableCell, PageStruct);
+			// The details view edits the cell in place
+			uint8* StructData = TableBeingEdited->GetMutableCellData(CellPtr.Pin()->TableCell, PageStruct);
 			check(StructData != nullptr);
 
 			DetailsView->SetStructureData(MakeShareable(new FStructOnScope(PageStruct, StructData)));
@@ -1164,6 +1188,28 @@ void FAffinityTableEditor::DisplaySelectedCellStruct()
 	}
 }
 
+bool FAffinityTableEditor::TickIdleCompaction(float DeltaTime)
+{
+	check(TableBeingEdited);
+
+	// Rows and columns being added or deleted show up as epoch changes
+	const double Now = FPlatformTime::Seconds();
+	if (TableBeingEdited->GetEpoch() != LastSeenEpoch)
+	{
+		LastSeenEpoch = TableBeingEdited->GetEpoch();
+		LastEditTime = Now;
+		bCompactionPending = true;
+	}
+
+	if (bCompactionPending && GAffinityTableCompactIdleSeconds > 0.0f && Now - LastEditTime >= GAffinityTableCompactIdleSeconds)
+	{
+		TableBeingEdited->CompactPages();
+		LastSeenEpoch = TableBeingEdited->GetEpoch();
+		bCompactionPending = false;
+	}
+	return true;
+}
+
 FSlateColor FAffinityTableEditor::GetVisibilityBtnForeground() const
 {
 	static const FName InvertedForegroundName("InvertedForeground");
@@ -1235,11 +1281,7 @@ void FAffinityTableEditor::UpdateCells(CellUpdateType UpdateTypes, TArray<TWeakP
 				if (ThisCell->InheritsData() &&
 					!TableBeingEdited->AreCellsIdentical(CurrentView->PageStruct, ThisCell->InheritedCell.Pin()->TableCell, ThisCell->TableCell))
 				{
-					const uint8* DataFrom = TableBeingEdited->GetCellData(ThisCell->InheritedCell.Pin()->TableCell, CurrentView->PageStruct);
-					uint8* DataTo = TableBeingEdited->GetCellData(ThisCell->TableCell, CurrentView->PageStruct);
-					check(DataFrom && DataTo);
-
-					CurrentView->PageStruct->CopyScriptStruct(DataTo, DataFrom);
+					verify(TableBeingEdited->CopyCell(CurrentView->PageStruct, ThisCell->InheritedCell.Pin()->TableCell, ThisCell->TableCell));
 					AssetNeedsSave = true;
 				}
 			});
@@ -1312,6 +1354,11 @@ void FAffinityTableEditor::OnCellValueChanged(TWeakPtr<Cell>& UpdatedCell)
 	TSharedPtr<Cell> UpdatedCellRef = UpdatedCell.Pin();
 
 	// No matter what we do, this is now a modified document
+	LastEditTime = FPlatformTime::Seconds();
+	if (ActivePageView.IsValid())
+	{
+		TableBeingEdited->MarkCellDirty(ActivePageView->PageStruct, UpdatedCellRef->TableCell);
+	}
 	TableBeingEdited->Modify();
 
 	// If this cell is inheriting data, mark it independent and update the inheritance chain, otherwise
@@ -1413,7 +1460,7 @@ void FAffinityTableEditor::PasteCellData(TArray<TWeakPtr<Cell>>& TargetCells, bo
 	{
 		const UScriptStruct* PageStruct = ActivePageView->PageStruct;
 		TSharedPtr<Cell> SourceCellPtr = ReferenceCell.Pin();
-		uint8* SourceData = TableBeingEdited->GetCellData(SourceCellPtr->TableCell, PageStruct);
+		const uint8* SourceData = TableBeingEdited->GetCellData(SourceCellPtr->TableCell, PageStruct);
 		check(SourceData);
 
 		// Clarity over performance. We are likely pasting a human-countable number of cells
@@ -1424,7 +1471,7 @@ void FAffinityTableEditor::PasteCellData(TArray<TWeakPtr<Cell>>& TargetCells, bo
 
 			if (SourceCellPtr != TargetCellPtr)
 			{
-				uint8* DestData = TableBeingEdited->GetCellData(TargetCellPtr->TableCell, PageStruct);
+				uint8* DestData = TableBeingEdited->GetMutableCellData(TargetCellPtr->TableCell, PageStruct);
 				check(DestData);
 
 				// Copy a partial dataset (most frequently)
@@ -1441,7 +1488,7 @@ void FAffinityTableEditor::PasteCellData(TArray<TWeakPtr<Cell>>& TargetCells, bo
 				// Copy the whole cell
 				else
 				{
-					PageStruct->CopyScriptStruct(DestData, SourceData);
+					verify(TableBeingEdited->CopyCell(PageStruct, SourceCellPtr->TableCell, TargetCellPtr->TableCell));
 					OnCellValueChanged(TargetCell);
 				}
 			}
@@ -15,6 +15,7 @@
  */
 #pragma once
 
+#include "Containers/Ticker.h"
 #include "CoreMinimal.h"
 #include "Editor/PropertyEditor/Public/PropertyEditorDelegates.h"
 #include "EditorUndoClient.h"
@@ -378,6 +379,13 @@ private:
 	 */
 	void DisplaySelectedCellStruct();
 
+	/**
+	 * Compacts our table once it has not been edited for AffinityTable.CompactIdleSeconds, see UAffinityTable::CompactPages
+	 * @param DeltaTime Time since the last tick
+	 * @return True to keep ticking
+	 */
+	bool TickIdleCompaction(float DeltaTime);
+
 	// Tag Picker
 	//
 	// The tag picker is a heavily simplified version of SGameplayTagWidget, which
@@ -650,4 +658,16 @@ private:
 
 	/** Whether we are currently adding a row or column tag */
 	bool SelectedTagIsRow;
+
+	/** Ticker for TickIdleCompaction */
+	FTSTicker::FDelegateHandle CompactionTicker;
+
+	/** Time of the last edit to our table, in seconds */
+	double LastEditTime;
+
+	/** Table epoch on our last compaction tick. Epoch changes count as edits */
+	uint32 LastSeenEpoch;
+
+	/** True if our table changed since it was last compacted */
+	bool bCompactionPending;
 };